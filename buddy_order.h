@@ -0,0 +1,37 @@
+//
+// Block arithmetic shared by the buddy heaps in malloc_3.cpp and
+// malloc_3_persistent.cpp. Blocks are 128 bytes << order for orders 0..10,
+// an arena is one block of the top order, and a block's buddy is found by
+// flipping its size bit in its offset from the start of the first arena, so
+// the same math works on pointers (from ba.base) and on file offsets.
+//
+#ifndef BUDDY_ORDER_H
+#define BUDDY_ORDER_H
+
+#include <cstddef>
+
+const int BUDDY_MAX_ORDER = 10;
+const size_t BUDDY_ARENA_SIZE = (size_t)128 << BUDDY_MAX_ORDER;
+
+inline size_t buddyBlockSize(int order){
+    return (size_t)128 << order;
+}
+
+// smallest order whose block holds bytes (header included), -1 if not even
+// a whole arena does
+inline int buddyOrderFor(size_t bytes){
+    if(bytes > BUDDY_ARENA_SIZE){
+        return -1;
+    }
+    if(bytes <= 128){
+        return 0;
+    }
+    return 64 - __builtin_clzl(bytes - 1) - 7;
+}
+
+// offsets from the start of the first arena
+inline size_t buddyOffset(size_t offset, int order){
+    return offset ^ buddyBlockSize(order);
+}
+
+#endif //BUDDY_ORDER_H
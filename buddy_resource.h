@@ -0,0 +1,112 @@
+//
+// std::pmr::memory_resource and standard allocator adaptors over the buddy
+// allocator in malloc_3.cpp, so single containers can live on the buddy heap
+// without replacing the global malloc:
+//
+//   std::pmr::map<int, Entry> index(buddy_resource());
+//   std::map<int, Entry, std::less<int>, SAllocator<std::pair<const int, Entry>>> index;
+//
+// Both pass the size back on deallocation, which goes through the sfree_sized
+// fast path, and take the heap lock (smalloc_lock) operator new and the
+// preload shim share, so containers in different threads can use them.
+//
+#ifndef BUDDY_RESOURCE_H
+#define BUDDY_RESOURCE_H
+
+#include <memory_resource>
+#include <new>
+
+#include "malloc_3.h"
+
+// containers on the resource hold a program's data: the heap grows past the
+// 32 arenas the tests use and the free lists stop sorting their inserts.
+// Called with the heap lock held
+inline void buddyGrowHeapCap(){
+    static bool grown = false;
+    if(!grown){
+        smalloc_set_max_arenas(SMALLOC_MAX_ARENAS);
+        smalloc_set_address_ordered(false);
+        grown = true;
+    }
+}
+
+inline void* buddyAllocate(size_t bytes, size_t alignment){
+    void* p;
+    {
+        SHeapLock lock;
+        buddyGrowHeapCap();
+        if(bytes > 1e8){
+            p = smalloc_mmap(bytes, alignment);
+        } else if(alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__){
+            p = smalloc(bytes ? bytes : 1);
+        } else{
+            p = saligned_alloc(alignment, bytes ? bytes : 1);
+        }
+    }
+    if(!p){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+inline void buddyDeallocate(void* p, size_t bytes, size_t alignment){
+    SHeapLock lock;
+    if(alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__){
+        sfree_sized(p, bytes ? bytes : 1);
+        return;
+    }
+    sfree(p);
+}
+
+class BuddyResource : public std::pmr::memory_resource{
+    void* do_allocate(size_t bytes, size_t alignment) override{
+        return buddyAllocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override{
+        buddyDeallocate(p, bytes, alignment);
+    }
+
+    // there is a single buddy heap, so every BuddyResource can free what another allocated
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override{
+        return dynamic_cast<const BuddyResource*>(&other) != nullptr;
+    }
+};
+
+inline BuddyResource* buddy_resource(){
+    static BuddyResource resource;
+    return &resource;
+}
+
+template <class T>
+struct SAllocator{
+    typedef T value_type;
+
+    SAllocator() noexcept = default;
+
+    template <class U>
+    SAllocator(const SAllocator<U>&) noexcept{}
+
+    T* allocate(size_t n){
+        if(n > (size_t)-1 / sizeof(T)){
+            throw std::bad_array_new_length();
+        }
+        return (T*)buddyAllocate(n * sizeof(T), alignof(T));
+    }
+
+    void deallocate(T* p, size_t n) noexcept{
+        buddyDeallocate(p, n * sizeof(T), alignof(T));
+    }
+};
+
+template <class T, class U>
+bool operator==(const SAllocator<T>&, const SAllocator<U>&) noexcept{
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const SAllocator<T>&, const SAllocator<U>&) noexcept{
+    return false;
+}
+
+#endif //BUDDY_RESOURCE_H
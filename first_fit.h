@@ -0,0 +1,48 @@
+//
+// The first-fit search over a structure-of-arrays size index, shared by
+// malloc_2.cpp's SizeIndex and policy_allocator.h's FirstFitPlacement.
+// free_sizes[i] is the size of the i-th block if it is free and 0 if it is
+// in use. Sizes are capped at 1e8 so they fit in 32 bits (and stay positive
+// for the signed compares), which lets a query compare 8 (AVX2) or 4 (SSE2)
+// blocks per instruction instead of chasing next pointers.
+//
+#ifndef FIRST_FIT_H
+#define FIRST_FIT_H
+
+#include <cstddef>
+#include <cstdint>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// first index whose free size is >= size, or count if there is none
+inline size_t firstFitIndex(const uint32_t* free_sizes, size_t count, size_t size){
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi32((int)(size - 1));
+    for(; i + 8 <= count; i += 8){
+        __m256i sizes = _mm256_loadu_si256((const __m256i*)(free_sizes + i));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(sizes, key)));
+        if(mask){
+            return i + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__SSE2__)
+    __m128i key = _mm_set1_epi32((int)(size - 1));
+    for(; i + 4 <= count; i += 4){
+        __m128i sizes = _mm_loadu_si128((const __m128i*)(free_sizes + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(sizes, key)));
+        if(mask){
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for(; i < count; i++){
+        if(free_sizes[i] >= size){
+            return i;
+        }
+    }
+    return count;
+}
+
+#endif //FIRST_FIT_H
@@ -3,26 +3,212 @@
 //
 #include <unistd.h>
 #include <iostream>
+#include <cstdint>
+#include <sys/mman.h>
 
 using namespace  std;
 
+const size_t ALIGNMENT = 16;
+const size_t CHUNK_SIZE = 1024 * 1024;
+const size_t MAX_CHUNK_SIZE = 64 * 1024 * 1024;
+
+size_t alignUp(size_t size){
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+// The break is reserved in chunks that double in size (up to MAX_CHUNK_SIZE),
+// and allocations bump a pointer inside the current chunk, so only a refill
+// enters the kernel.
+struct BumpChunk{
+    char* next = nullptr;
+    char* end = nullptr;
+    size_t chunk_size = CHUNK_SIZE;
+
+    bool refill(size_t size){
+        char* brk = (char*)sbrk(0);
+        if(brk == (char*)(-1)){
+            return false;
+        }
+        // if someone else moved the break, start a fresh aligned chunk there
+        bool contiguous = (brk == end);
+        size_t pad = contiguous ? 0 : alignUp((uintptr_t)brk) - (uintptr_t)brk;
+        size_t missing = contiguous ? size - (end - next) : size;
+        size_t request = (missing > chunk_size ? missing : chunk_size) + pad;
+        if(sbrk(request) == (void*)(-1)){
+            return false;
+        }
+        if(!contiguous){
+            next = brk + pad;
+        }
+        end = brk + request;
+        if(chunk_size < MAX_CHUNK_SIZE){
+            chunk_size *= 2;
+        }
+        return true;
+    }
+
+    void* allocate(size_t size){
+        size = alignUp(size);
+        if((size_t)(end - next) < size && !refill(size)){
+            return nullptr;
+        }
+        void* ret = next;
+        next += size;
+        return ret;
+    }
+};
+
+BumpChunk chunk;
+
 void* smalloc(size_t size){
     //if size is 0
     if(size == 0 || size > 1e8){
         return nullptr;
     }
-    void* ret = sbrk(size);
-    if(ret == (void*)(-1)){
-        cout << "return -1" << endl;
+    return chunk.allocate(size);
+}
+// A region built on the same bump design: chunks come from mmap instead of
+// sbrk so the whole region can be handed back, and there is no per-object
+// free. sarena_mark returns the current bump pointer and sarena_rewind
+// drops everything allocated after it.
+struct ArenaChunk{
+    ArenaChunk* prev;
+    size_t size;
+};
+
+struct Arena{
+    ArenaChunk* current;
+    ArenaChunk* spare;   // largest chunk dropped by a rewind, reused by the next refill
+    char* next;
+    char* end;
+    size_t chunk_size;
+};
+
+const size_t CHUNK_HEADER_SIZE = alignUp(sizeof(ArenaChunk));
+
+ArenaChunk* mapChunk(size_t size){
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED){
         return nullptr;
     }
+    ArenaChunk* chunk = (ArenaChunk*)p;
+    chunk->prev = nullptr;
+    chunk->size = size;
+    return chunk;
+}
+
+char* chunkData(ArenaChunk* chunk){
+    return (char*)chunk + CHUNK_HEADER_SIZE;
+}
+
+void dropChunk(Arena* arena, ArenaChunk* chunk){
+    if(!arena->spare || arena->spare->size < chunk->size){
+        swap(arena->spare, chunk);
+    }
+    if(chunk){
+        munmap(chunk, chunk->size);
+    }
+}
+
+bool arenaRefill(Arena* arena, size_t size){
+    ArenaChunk* chunk;
+    if(arena->spare && arena->spare->size - CHUNK_HEADER_SIZE >= size){
+        chunk = arena->spare;
+        arena->spare = nullptr;
+    } else{
+        size_t chunk_size = arena->chunk_size;
+        if(size + CHUNK_HEADER_SIZE > chunk_size){
+            chunk_size = size + CHUNK_HEADER_SIZE;
+        }
+        chunk = mapChunk(chunk_size);
+        if(!chunk){
+            return false;
+        }
+        if(arena->chunk_size < MAX_CHUNK_SIZE){
+            arena->chunk_size *= 2;
+        }
+    }
+    chunk->prev = arena->current;
+    arena->current = chunk;
+    arena->next = chunkData(chunk);
+    arena->end = (char*)chunk + chunk->size;
+    return true;
+}
+
+Arena* sarena_create(size_t size){
+    size = alignUp(size ? size : CHUNK_SIZE);
+    size_t header = CHUNK_HEADER_SIZE + alignUp(sizeof(Arena));
+    ArenaChunk* chunk = mapChunk(header + size);
+    if(!chunk){
+        return nullptr;
+    }
+    Arena* arena = (Arena*)chunkData(chunk);
+    arena->current = chunk;
+    arena->spare = nullptr;
+    arena->next = (char*)chunk + header;
+    arena->end = (char*)chunk + chunk->size;
+    arena->chunk_size = size < CHUNK_SIZE ? CHUNK_SIZE : size;
+    return arena;
+}
+
+void* sarena_alloc(Arena* arena, size_t size){
+    if(!arena || size == 0 || size > 1e8){
+        return nullptr;
+    }
+    size = alignUp(size);
+    if((size_t)(arena->end - arena->next) < size && !arenaRefill(arena, size)){
+        return nullptr;
+    }
+    void* ret = arena->next;
+    arena->next += size;
     return ret;
 }
 
+void* sarena_mark(Arena* arena){
+    return arena->next;
+}
+
+void sarena_rewind(Arena* arena, void* mark){
+    char* p = (char*)mark;
+    while(arena->current->prev &&
+          (p < chunkData(arena->current) || p > (char*)arena->current + arena->current->size)){
+        ArenaChunk* chunk = arena->current;
+        arena->current = chunk->prev;
+        dropChunk(arena, chunk);
+    }
+    arena->next = p;
+    arena->end = (char*)arena->current + arena->current->size;
+}
+
+void sarena_reset(Arena* arena){
+    while(arena->current->prev){
+        ArenaChunk* chunk = arena->current;
+        arena->current = chunk->prev;
+        dropChunk(arena, chunk);
+    }
+    arena->next = (char*)arena->current + CHUNK_HEADER_SIZE + alignUp(sizeof(Arena));
+    arena->end = (char*)arena->current + arena->current->size;
+}
+
+void sarena_destroy(Arena* arena){
+    if(!arena){
+        return;
+    }
+    if(arena->spare){
+        munmap(arena->spare, arena->spare->size);
+    }
+    ArenaChunk* chunk = arena->current;
+    while(chunk){
+        ArenaChunk* prev = chunk->prev;
+        munmap(chunk, chunk->size);
+        chunk = prev;
+    }
+}
+
 
 
 //int main(){
 //
 //    cout << "p1: " << p1 << endl;
 //    return 0;
-//}
\ No newline at end of file
+//}
@@ -4,6 +4,9 @@
 #include <unistd.h>
 #include <iostream>
 #include <cstring>
+#include <cstdint>
+#include <sys/mman.h>
+#include "first_fit.h"
 using namespace std;
 
 
@@ -12,13 +15,75 @@ struct MallocMetadata {
     bool is_free;
     MallocMetadata* next;
     MallocMetadata* prev;
+    size_t index; // position of the block in the SizeIndex
 };
 const size_t BYTE_SIZE = sizeof(MallocMetadata);
+const size_t INDEX_INITIAL_CAPACITY = 1024;
 
 size_t _size_meta_data(){
     return sizeof(MallocMetadata);
 }
 
+// Structure-of-arrays copy of the block list: free_sizes[i] is the size of the
+// i-th block if it is free and 0 if it is in use, blocks[i] is its metadata.
+// firstFit is the SIMD search in first_fit.h. The arrays live in mmap'd
+// memory so they don't show up in the sbrk heap.
+struct SizeIndex{
+    uint32_t* free_sizes = nullptr;
+    MallocMetadata** blocks = nullptr;
+    size_t count = 0;
+    size_t capacity = 0;
+
+    bool grow(){
+        size_t new_capacity = capacity ? capacity * 2 : INDEX_INITIAL_CAPACITY;
+        void* sizes = mmap(nullptr, new_capacity * sizeof(uint32_t), PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(sizes == MAP_FAILED){
+            return false;
+        }
+        void* ptrs = mmap(nullptr, new_capacity * sizeof(MallocMetadata*), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(ptrs == MAP_FAILED){
+            munmap(sizes, new_capacity * sizeof(uint32_t));
+            return false;
+        }
+        if(capacity){
+            memcpy(sizes, free_sizes, count * sizeof(uint32_t));
+            memcpy(ptrs, blocks, count * sizeof(MallocMetadata*));
+            munmap(free_sizes, capacity * sizeof(uint32_t));
+            munmap(blocks, capacity * sizeof(MallocMetadata*));
+        }
+        free_sizes = (uint32_t*)sizes;
+        blocks = (MallocMetadata**)ptrs;
+        capacity = new_capacity;
+        return true;
+    }
+
+    bool reserve(){
+        return count < capacity || grow();
+    }
+
+    void append(MallocMetadata* p){
+        p->index = count;
+        free_sizes[count] = 0;
+        blocks[count] = p;
+        count++;
+    }
+
+    void setFree(MallocMetadata* p){
+        free_sizes[p->index] = (uint32_t)p->size;
+    }
+
+    void setUsed(MallocMetadata* p){
+        free_sizes[p->index] = 0;
+    }
+
+    // first index whose free size is >= size, or count if there is none
+    size_t firstFit(size_t size){
+        return firstFitIndex(free_sizes, count, size);
+    }
+};
+
 struct HeapMetaData{
     size_t num_free_blocks = 0;
     size_t num_free_bytes = 0;
@@ -27,29 +92,48 @@ struct HeapMetaData{
     size_t num_meta_data_bytes = 0;
     MallocMetadata* head = nullptr;
     MallocMetadata* tail = nullptr;
+    SizeIndex index;
     void* searchAndInsert(size_t size){
-        MallocMetadata* current = head;
-        while(current){
-            if(current->is_free && current->size >= size){
-                //TODO: insert the block update the data
-//                return current->block_start;
-                current->is_free = false;
-                num_free_blocks--;
-                num_free_bytes -= current->size;
-//                num_allocated_blocks++;
-//                num_allocated_bytes += current->size;
-                return (char*)current + BYTE_SIZE;
-            }
-            current = current->next;
+        size_t i = index.firstFit(size);
+        if(i == index.count){
+            return nullptr;
         }
-        return nullptr;
+        MallocMetadata* current = index.blocks[i];
+        current->is_free = false;
+        index.setUsed(current);
+        num_free_blocks--;
+        num_free_bytes -= current->size;
+        return (char*)current + BYTE_SIZE;
+    }
+
+    void* extendTail(size_t size){
+        // the free wilderness block only needs the missing bytes from sbrk
+        size_t missing = size - tail->size;
+        void* ret = sbrk(missing);
+        if(ret == (void*)(-1)){
+            return nullptr;
+        }
+        num_free_blocks--;
+        num_free_bytes -= tail->size;
+        num_allocated_bytes += missing;
+        tail->size = size;
+        tail->is_free = false;
+        index.setUsed(tail);
+        return (char*)tail + BYTE_SIZE;
     }
 
     void* insertNewBlock(size_t size){
-        //TODO: use sbrk(), update HMD,
+        //wilderness block: extend the free tail instead of adding a new block,
+        //as long as nothing else moved the program break after it
+        if(tail && tail->is_free && tail->size < size &&
+           sbrk(0) == (char*)tail + BYTE_SIZE + tail->size){
+            return extendTail(size);
+        }
+        if(!index.reserve()){
+            return nullptr;
+        }
         void* ret = sbrk(size + BYTE_SIZE);
         if(ret == (void*)(-1)){
-            cout << "return -1" << endl;
             return nullptr;
         }
         MallocMetadata* meta_ptr = (MallocMetadata*)(ret);
@@ -64,6 +148,7 @@ struct HeapMetaData{
             tail->next = meta_ptr;
         }
         tail = meta_ptr;
+        index.append(meta_ptr);
         num_allocated_blocks++;
         num_allocated_bytes += size;
         num_meta_data_bytes += BYTE_SIZE;
@@ -138,6 +223,7 @@ void sfree(void* p){
         hmd.num_free_bytes += tmp->size;
 //        hmd.num_allocated_blocks--;
         tmp->is_free = true;
+        hmd.index.setFree(tmp);
     }
 }
 
@@ -4,26 +4,47 @@
 #include <unistd.h>
 #include <iostream>
 #include <cstring>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <new>
 
 #include <sys/mman.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <vector>
 #include <complex>
+#include <pthread.h>
+
+#include "malloc_3.h"
+#include "buddy_order.h"
 
 using namespace std;
-#define MMAP_TREHSHOLD 128*1024
+#define MMAP_TREHSHOLD (128*1024)
+#define ALIGNMENT 16
+#define NUM_ARENAS 32
+#define SREALLOC_HEADROOM_GROWS 4 // from this many grows on, a block srealloc moves to mmap gets room to grow into
+#define RESERVED_ARENAS SMALLOC_MAX_ARENAS // 1GB of address space for the global heap to grow into
+#define SFREE_BATCH_CHUNK 256 // pointers sfree_batch sorts at a time
 
 
-struct MallocMetadata {
+// aligned to 16 so the user data after it keeps malloc's max_align_t guarantee
+struct alignas(ALIGNMENT) MallocMetadata {
     size_t size;
     bool is_free;
     bool is_mmap = false; // for the free part
+    unsigned short grows; // times srealloc has grown the block
+    int fd; // mmap'd blocks: the memfd behind a cloned block, -1 for anonymous memory
     MallocMetadata* next = nullptr;
     MallocMetadata* prev = nullptr;
     MallocMetadata* buddy = nullptr;
 };
 
 const size_t BYTE_SIZE = sizeof(MallocMetadata);
-const int MAX_ORDER = 10;
+static_assert(BYTE_SIZE == SMALLOC_META_DATA_SIZE, "smalloc<N> orders assume this header size");
+const int MAX_ORDER = BUDDY_MAX_ORDER;
+const size_t NUM_GRANULES = NUM_ARENAS * MMAP_TREHSHOLD / 128;
+const size_t RESERVED_GRANULES = (size_t)RESERVED_ARENAS * MMAP_TREHSHOLD / 128;
 
 
 
@@ -31,6 +52,236 @@ size_t _size_meta_data(){
     return sizeof(MallocMetadata);
 }
 
+// ------------------------------------------------------------------ providers
+//
+// Where arena memory comes from. The global heap uses heap_provider (a
+// reservation of RESERVED_ARENAS arenas unless smalloc_use_provider picked
+// another one before the first allocation), an SHeap uses the provider it was
+// created with for both its arenas and its allocator state. Blocks above the
+// threshold are still mmap'd.
+
+static char* alignPointer(char* p, size_t alignment){
+    return (char*)(((size_t)p + alignment - 1) & ~(alignment - 1));
+}
+
+// arenas are taken from the break, so they keep following the program's data
+static void* sbrkAcquire(SProvider*, size_t size, size_t alignment){
+    size_t brk = (size_t)sbrk(0);
+    if(brk % alignment && sbrk(alignment - brk % alignment) == (void*)(-1)){
+        return nullptr;
+    }
+    void* p = sbrk(size);
+    return p == (void*)(-1) ? nullptr : p;
+}
+
+static void sbrkRelease(SProvider*, void*, size_t){
+    // the break is never moved back
+}
+
+// maps alignment bytes of slack and unmaps what is left around the aligned part
+static void* mmapAligned(size_t size, size_t alignment, int flags){
+    size_t page = getpagesize();
+    if(alignment < page){
+        alignment = page;
+    }
+    size = (size + page - 1) & ~(page - 1);
+    size_t total_size = size + alignment - page;
+    char* raw = (char*)mmap(nullptr, total_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    if(raw == MAP_FAILED){
+        return nullptr;
+    }
+    char* start = alignPointer(raw, alignment);
+    if(start > raw){
+        munmap(raw, start - raw);
+    }
+    if(start + size < raw + total_size){
+        munmap(start + size, raw + total_size - (start + size));
+    }
+    return start;
+}
+
+static void* mmapAcquire(SProvider*, size_t size, size_t alignment){
+    return mmapAligned(size, alignment, 0);
+}
+
+static void mmapRelease(SProvider*, void* p, size_t size){
+    munmap(p, size);
+}
+
+// hugetlb pages when the system has them reserved, otherwise regular memory
+// the kernel is asked to back with transparent huge pages. Both are mapped in
+// whole huge pages so release doesn't need to know which one it got
+static const size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+static void* hugetlbAcquire(SProvider*, size_t size, size_t alignment){
+    size = (size + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+    if(alignment <= HUGE_PAGE){
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(p != MAP_FAILED){
+            return p;
+        }
+    }
+    void* p = mmapAligned(size, alignment > HUGE_PAGE ? alignment : HUGE_PAGE, 0);
+    if(p){
+        madvise(p, size, MADV_HUGEPAGE);
+    }
+    return p;
+}
+
+static void hugetlbRelease(SProvider*, void* p, size_t size){
+    munmap(p, (size + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1));
+}
+
+// a shared mapping of an anonymous file laid over an aligned reservation;
+// the fd is closed right away, the mapping keeps the file alive
+static void* memfdAcquire(SProvider*, size_t size, size_t alignment){
+    size_t page = getpagesize();
+    size = (size + page - 1) & ~(page - 1);
+    int fd = memfd_create("malloc_3", MFD_CLOEXEC);
+    if(fd == -1){
+        return nullptr;
+    }
+    void* p = nullptr;
+    if(ftruncate(fd, size) == 0){
+        p = mmapAligned(size, alignment, MAP_NORESERVE);
+    }
+    if(p && mmap(p, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED){
+        munmap(p, size);
+        p = nullptr;
+    }
+    close(fd);
+    return p;
+}
+
+static void memfdRelease(SProvider*, void* p, size_t size){
+    size_t page = getpagesize();
+    munmap(p, (size + page - 1) & ~(page - 1));
+}
+
+// hands out consecutive pieces of [next, end). The region keeps its own state
+// at its start, so a fixed buffer needs nothing besides itself. With commit,
+// the region is reserved PROT_NONE and pieces are only made accessible (and
+// backed by memory) once acquired
+struct RegionProvider{
+    SProvider provider;
+    char* next;
+    char* end;
+    bool commit;
+};
+
+static void* regionAcquire(SProvider* provider, size_t size, size_t alignment){
+    RegionProvider* region = (RegionProvider*)provider;
+    if(region->commit){
+        size_t page = getpagesize();
+        size = (size + page - 1) & ~(page - 1);
+    }
+    char* p = alignPointer(region->next, alignment);
+    if(p > region->end || size > (size_t)(region->end - p)){
+        return nullptr;
+    }
+    if(region->commit && mprotect(p, size, PROT_READ | PROT_WRITE) != 0){
+        return nullptr;
+    }
+    region->next = p + size;
+    return p;
+}
+
+// only the last piece can be handed out again; an earlier one is decommitted
+// but its address range is not reused
+static void regionRelease(SProvider* provider, void* p, size_t size){
+    RegionProvider* region = (RegionProvider*)provider;
+    if(region->commit){
+        size_t page = getpagesize();
+        size = (size + page - 1) & ~(page - 1);
+        madvise(p, size, MADV_DONTNEED);
+        mprotect(p, size, PROT_NONE);
+    }
+    if((char*)p + size == region->next){
+        region->next = (char*)p;
+    }
+}
+
+static SProvider sbrk_provider = {sbrkAcquire, sbrkRelease};
+static SProvider mmap_provider = {mmapAcquire, mmapRelease};
+static SProvider hugetlb_provider = {hugetlbAcquire, hugetlbRelease};
+static SProvider memfd_provider = {memfdAcquire, memfdRelease};
+
+SProvider* sprovider_sbrk(){
+    return &sbrk_provider;
+}
+
+SProvider* sprovider_mmap(){
+    return &mmap_provider;
+}
+
+SProvider* sprovider_hugetlb(){
+    return &hugetlb_provider;
+}
+
+SProvider* sprovider_memfd(){
+    return &memfd_provider;
+}
+
+SProvider* sprovider_reserved(size_t capacity){
+    size_t page = getpagesize();
+    capacity = (capacity + page - 1) & ~(page - 1);
+    char* start = (char*)mmap(nullptr, capacity + page, PROT_NONE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(start == MAP_FAILED){
+        return nullptr;
+    }
+    if(mprotect(start, page, PROT_READ | PROT_WRITE) != 0){
+        munmap(start, capacity + page);
+        return nullptr;
+    }
+    RegionProvider* region = (RegionProvider*)start;
+    region->provider = {regionAcquire, regionRelease};
+    region->next = start + page;
+    region->end = start + page + capacity;
+    region->commit = true;
+    return &region->provider;
+}
+
+SProvider* sprovider_fixed(void* buffer, size_t size){
+    char* start = alignPointer((char*)buffer, alignof(RegionProvider));
+    if(!buffer || start + sizeof(RegionProvider) > (char*)buffer + size){
+        return nullptr;
+    }
+    RegionProvider* region = (RegionProvider*)start;
+    region->provider = {regionAcquire, regionRelease};
+    region->next = start + sizeof(RegionProvider);
+    region->end = (char*)buffer + size;
+    region->commit = false;
+    return &region->provider;
+}
+
+// the global heap's default: the reservation is only made on the first
+// acquire, so nothing runs before main and the break is left alone
+static void* defaultAcquire(SProvider* provider, size_t size, size_t alignment);
+static RegionProvider default_region = {{defaultAcquire, regionRelease}, nullptr, nullptr, true};
+
+static void* defaultAcquire(SProvider* provider, size_t size, size_t alignment){
+    if(!default_region.next){
+        size_t capacity = (size_t)RESERVED_ARENAS * MMAP_TREHSHOLD + MMAP_TREHSHOLD;
+        char* start = (char*)mmap(nullptr, capacity, PROT_NONE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(start == MAP_FAILED){
+            return nullptr;
+        }
+        default_region.next = start;
+        default_region.end = start + capacity;
+    }
+    return regionAcquire(provider, size, alignment);
+}
+
+static SProvider* heap_provider = &default_region.provider;
+
+// aligned block orders of the global heap, sized for all the arenas it may
+// grow to. Untouched parts of it never get memory
+static unsigned char global_aligned_orders[RESERVED_GRANULES];
+
 //TODO: add Orders array
 
 //TODO: understand how to split blocks and how to keep track of allocated blocks
@@ -39,8 +290,9 @@ size_t _size_meta_data(){
 
 
 struct BuddyAllocator{
-    MallocMetadata* array[MAX_ORDER + 1];
-    int orders[MAX_ORDER + 1];
+    MallocMetadata* array[MAX_ORDER + 1] = {};
+    int orders[MAX_ORDER + 1] = {};
+    char* base = nullptr; // start of the first arena, buddies are found relative to it
     MallocMetadata *mmapHead = nullptr;
     MallocMetadata *mmapTail = nullptr;
     size_t num_free_blocks = 0;
@@ -48,14 +300,56 @@ struct BuddyAllocator{
     size_t num_used_blocks = 0;
     size_t num_used_bytes = 0;
     size_t num_meta_data_bytes = 0; //TODO: if matters
+    int num_arenas = 0;
+    int max_arenas = NUM_ARENAS; // a miss with fewer arenas than this grows the heap
+    // free lists sorted by address, so a split always takes the lowest free
+    // block. Inserting walks the list, which is quadratic with many free blocks
+    bool address_ordered = true;
+    SProvider* provider = nullptr;
+    // order + 1 of the headerless aligned block starting at each 128 byte
+    // granule of the arenas, 0 if no such block starts there
+    unsigned char* aligned_orders = global_aligned_orders;
 
 
     void init(){
-        num_free_blocks = 32;
-        num_free_bytes = 32 * (MMAP_TREHSHOLD - BYTE_SIZE);
+        // arenas start on a 128KB boundary so every block is naturally aligned to its size
+        char* start = (char*)heap_provider->acquire(heap_provider, NUM_ARENAS * MMAP_TREHSHOLD, MMAP_TREHSHOLD);
+        provider = heap_provider;
+        initArenas(start, start ? NUM_ARENAS : 0);
+    }
+
+    // adds one arena right after the last one. With a reservation that is
+    // just committing it; a provider that can't give the next address range
+    // leaves the heap as it is
+    bool growArenas(){
+        if(!base || num_arenas >= max_arenas){
+            return false;
+        }
+        char* end = base + num_arenas * MMAP_TREHSHOLD;
+        char* arena = (char*)provider->acquire(provider, MMAP_TREHSHOLD, MMAP_TREHSHOLD);
+        if(!arena){
+            return false;
+        }
+        if(arena != end){
+            provider->release(provider, arena, MMAP_TREHSHOLD);
+            return false;
+        }
+        num_arenas++;
+        num_meta_data_bytes += BYTE_SIZE;
+        MallocMetadata* meta_ptr = (MallocMetadata*)arena;
+        meta_ptr->buddy = nullptr;
+        insert(meta_ptr, MAX_ORDER);
+        return true;
+    }
+
+    // start must be aligned to MMAP_TREHSHOLD and hold arenas max order blocks
+    void initArenas(char* start, int arenas){
+        num_arenas = arenas;
+        num_free_blocks = arenas;
+        num_free_bytes = arenas * (MMAP_TREHSHOLD - BYTE_SIZE);
         num_used_blocks = 0;
         num_used_bytes = 0;
-        num_meta_data_bytes = 32 * BYTE_SIZE; //TODO: if matters
+        num_meta_data_bytes = arenas * BYTE_SIZE; //TODO: if matters
 
         int num = 128;
         for(int i = 0; i <= MAX_ORDER; i++) {
@@ -63,39 +357,33 @@ struct BuddyAllocator{
             num *= 2;
             array[i] = nullptr;
         }
+        base = start;
+        array[MAX_ORDER] = (MallocMetadata*)start;
         MallocMetadata* prev = nullptr;
-        for(int i = 0; i < 32; i++){
-            MallocMetadata* meta_ptr = (MallocMetadata*)sbrk(1024 * 128);
+        for(int i = 0; i < arenas; i++){
+            MallocMetadata* meta_ptr = (MallocMetadata*)(start + i * MMAP_TREHSHOLD);
             meta_ptr->size = 1024 * 128 - BYTE_SIZE;
             meta_ptr->is_free = true;
             meta_ptr->buddy = nullptr;
             meta_ptr->is_mmap = false;
             meta_ptr->prev = prev;
+            meta_ptr->next = nullptr;
             if (prev){
                 prev->next = meta_ptr;
             }
-            if (i == 0){
-                array[MAX_ORDER] = meta_ptr;
-            }
-            if (i == 31){
-                meta_ptr->next = nullptr;
-            }
             prev = meta_ptr;
         }
 
     }
 
+    // smallest order whose block fits size plus the header: ceil(log2) of the
+    // block size, minus log2 of the order 0 block (128)
     int getOrder(size_t size){
-        int tmp = size + BYTE_SIZE;
-        if ((size_t)tmp < BYTE_SIZE || (size_t)tmp > 128 * 1024) {
-
+        size_t tmp = size + BYTE_SIZE;
+        if (tmp < BYTE_SIZE) {
             return -1;
         }
-        for (int i = 0; i <= MAX_ORDER; i++) {
-
-            if (orders[i] >= tmp) { return i; }
-        }
-        return -1;
+        return buddyOrderFor(tmp);
     }
 
     void insert(MallocMetadata* p, int order){
@@ -106,10 +394,15 @@ struct BuddyAllocator{
         MallocMetadata* current = head;
         p->size = orders[order] - BYTE_SIZE;
         p->is_free = true;
-        if(!current) {
+        p->is_mmap = false; // may be user data if this was a headerless aligned block
+        if(!current || !address_ordered) { // unordered lists push to the front
             array[order] = p;
             p->prev = nullptr;
-            p->next = nullptr;
+            p->next = current;
+            if(current){
+                current->prev = p;
+            }
+            current = nullptr;
         }
 
         while (current){
@@ -157,6 +450,7 @@ struct BuddyAllocator{
         p->next = nullptr;
         p->prev = nullptr;
         p->is_free = false;
+        p->grows = 0;
 
         num_free_bytes -= p->size;
         num_free_blocks--;
@@ -189,32 +483,123 @@ struct BuddyAllocator{
         return left;
     }
 
+    MallocMetadata* takeBlock(int order){
+        for(int i = order; i <= MAX_ORDER; i++){
+            if(array[i]){
+                return divideBlock(array[i], orders[order] - BYTE_SIZE, order, i);
+            }
+        }
+        if(growArenas()){
+            return divideBlock(array[MAX_ORDER], orders[order] - BYTE_SIZE, order, MAX_ORDER);
+        }
+        return nullptr;
+    }
+
+    // returns units [first, total) of a block made of total order blocks to
+    // the free lists as the fewest buddy blocks; total is a power of two, so
+    // the lowest set bit of first is always the largest aligned piece
+    void releaseTail(char* start, int order, size_t first, size_t total){
+        while(first < total){
+            int j = __builtin_ctzl(first);
+            insert((MallocMetadata*)(start + first * orders[order]), order + j);
+            first += (size_t)1 << j;
+        }
+    }
+
+    // fills out with up to n blocks of the given order, splitting each larger
+    // block once for as many of them as still fit instead of one divideBlock each
+    size_t takeBlocks(int order, size_t n, void** out){
+        size_t taken = 0;
+        while(taken < n){
+            size_t remaining = n - taken;
+            int want = order;
+            while(want < MAX_ORDER && ((size_t)1 << (want - order)) < remaining){
+                want++;
+            }
+            int i = want;
+            while(i <= MAX_ORDER && !array[i]){
+                i++;
+            }
+            if(i > MAX_ORDER){ // nothing big enough for all of them, use the biggest left
+                i = want - 1;
+                while(i >= order && !array[i]){
+                    i--;
+                }
+                if(i < order){
+                    if(growArenas()){
+                        continue;
+                    }
+                    break;
+                }
+            }
+            char* block = (char*)array[i];
+            remove(array[i], i);
+            size_t total = (size_t)1 << (i - order);
+            size_t count = remaining < total ? remaining : total;
+            for(size_t k = 0; k < count; k++){
+                MallocMetadata* p = (MallocMetadata*)(block + k * orders[order]);
+                p->size = orders[order] - BYTE_SIZE;
+                p->is_free = false;
+                p->is_mmap = false;
+                p->grows = 0;
+                p->next = nullptr;
+                p->prev = nullptr;
+                p->buddy = nullptr;
+                out[taken++] = (char*)p + BYTE_SIZE;
+            }
+            releaseTail(block, order, count, total);
+        }
+        return taken;
+    }
+
     void* searchBlock(size_t size){
         int order = getOrder(size);
         if(order == -1){
             return nullptr;
         }
-        for(int i = order; i <= MAX_ORDER; i++){
-            if(array[i]){
-                MallocMetadata* ret = divideBlock(array[i],size,order, i);
-                return (char*)ret + BYTE_SIZE;
-            }
+        MallocMetadata* ret = takeBlock(order);
+        if(!ret){
+            return nullptr;
         }
-        return nullptr;
+        return (char*)ret + BYTE_SIZE;
     }
 
-    void* mmapBlock(size_t size){
-        size_t total_size = size + BYTE_SIZE;
+    // smallest order whose block is at least size bytes, without a header
+    int getAlignedOrder(size_t size){
+        return buddyOrderFor(size);
+    }
 
-        MallocMetadata* p = (MallocMetadata*)mmap(nullptr, total_size,
-                                                  PROT_READ | PROT_WRITE,
-                                                  MAP_PRIVATE | MAP_ANONYMOUS,
-                                                  -1, 0);
-        if(!p){
+    // a block of the order that fits both the size and the alignment is
+    // naturally aligned, so it is handed out whole and its order is kept in
+    // aligned_orders instead of a header
+    void* alignedBlock(size_t size, size_t alignment){
+        int order = getAlignedOrder(size > alignment ? size : alignment);
+        MallocMetadata* ret = takeBlock(order);
+        if(!ret){
             return nullptr;
         }
+        aligned_orders[((char*)ret - base) / orders[0]] = order + 1;
+        return ret;
+    }
+
+    // order of the headerless aligned block at p, or -1 if p is a regular block
+    int alignedOrder(void* p){
+        char* c = (char*)p;
+        if(!base || c < base || c >= base + num_arenas * MMAP_TREHSHOLD){
+            return -1;
+        }
+        size_t offset = c - base;
+        if(offset % orders[0]){
+            return -1;
+        }
+        return aligned_orders[offset / orders[0]] - 1;
+    }
+
+    void addMmapped(MallocMetadata* p, size_t size, int fd){
         p->is_mmap = true;
         p->is_free = false;
+        p->grows = 0;
+        p->fd = fd;
         if(mmapTail) {
             mmapTail->next = p;
         }
@@ -225,6 +610,19 @@ struct BuddyAllocator{
         mmapTail = p;
         p->next = nullptr;
         p->size = size;
+    }
+
+    void* mmapBlock(size_t size){
+        size_t total_size = size + BYTE_SIZE;
+
+        MallocMetadata* p = (MallocMetadata*)mmap(nullptr, total_size,
+                                                  PROT_READ | PROT_WRITE,
+                                                  MAP_PRIVATE | MAP_ANONYMOUS,
+                                                  -1, 0);
+        if(p == MAP_FAILED){
+            return nullptr;
+        }
+        addMmapped(p, size, -1);
 
 //            num_used_blocks++;
 //            num_used_bytes+=p->size;
@@ -233,6 +631,30 @@ struct BuddyAllocator{
         return ((char*)p+BYTE_SIZE);
     }
 
+    // the header sits right before the aligned user pointer, the pages in front
+    // of the header and after the block are unmapped again
+    void* mmapAlignedBlock(size_t size, size_t alignment){
+        size_t page = getpagesize();
+        size_t total_size = size + BYTE_SIZE + alignment;
+        char* raw = (char*)mmap(nullptr, total_size, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(raw == MAP_FAILED){
+            return nullptr;
+        }
+        size_t user = ((size_t)raw + BYTE_SIZE + alignment - 1) & ~(alignment - 1);
+        MallocMetadata* p = (MallocMetadata*)(user - BYTE_SIZE);
+        char* start = (char*)((size_t)p & ~(page - 1));
+        char* end = (char*)((user + size + page - 1) & ~(page - 1));
+        if(start > raw){
+            munmap(raw, start - raw);
+        }
+        if(end < raw + total_size){
+            munmap(end, raw + total_size - end);
+        }
+        addMmapped(p, size, -1);
+        return (void*)user;
+    }
+
     void ummapBlock(MallocMetadata* p){
         if (p->prev){
             p->prev->next = p->next;
@@ -252,33 +674,238 @@ struct BuddyAllocator{
 //        num_used_blocks--;
 //        num_used_bytes-=p->size;
 //        num_meta_data_bytes-=BYTE_SIZE;
-        munmap(p,p->size+BYTE_SIZE);
+        if(p->fd != -1){
+            close(p->fd);
+        }
+        // aligned blocks don't start on a page, unmap from the page holding the header
+        char* start = (char*)((size_t)p & ~((size_t)getpagesize() - 1));
+        munmap(start, (char*)p + BYTE_SIZE + p->size - start);
     }
 
-    MallocMetadata* uniteBlocks(MallocMetadata* metaPtr){
+    // resizes an mmap'd block's mapping: in place when the pages after it are
+    // free, otherwise the kernel moves the page table entries, not the data.
+    // The memfd behind a cloned block is grown to cover the new pages
+    MallocMetadata* remapBlock(MallocMetadata* p, size_t size, bool may_move = true){
+        size_t page = getpagesize();
+        char* start = (char*)((size_t)p & ~(page - 1));
+        size_t old_length = (char*)p + BYTE_SIZE + p->size - start;
+        size_t new_length = (char*)p + BYTE_SIZE + size - start;
+        size_t file_length = (new_length + page - 1) & ~(page - 1);
+        struct stat st;
+        if(p->fd != -1 && (fstat(p->fd, &st) != 0 ||
+           ((size_t)st.st_size < file_length && ftruncate(p->fd, file_length) != 0))){
+            return nullptr;
+        }
+        char* moved = (char*)mremap(start, old_length, new_length, 0);
+        if(moved == MAP_FAILED && may_move){
+            moved = (char*)mremap(start, old_length, new_length, MREMAP_MAYMOVE);
+        }
+        if(moved == MAP_FAILED){
+            return nullptr;
+        }
+        MallocMetadata* ret = (MallocMetadata*)(moved + ((char*)p - start));
+        if(ret->prev){
+            ret->prev->next = ret;
+        } else{
+            mmapHead = ret;
+        }
+        if(ret->next){
+            ret->next->prev = ret;
+        } else{
+            mmapTail = ret;
+        }
+        num_used_bytes = num_used_bytes - ret->size + size;
+        ret->size = size;
+        return ret;
+    }
+
+    // the block's memory moves into a memfd: the pages are written to the file
+    // once and the block is mapped privately over the file in place. From then
+    // on the file never changes, clones and the block all copy on write from it
+    bool freezeBlock(MallocMetadata* p){
+        size_t length = (BYTE_SIZE + p->size + getpagesize() - 1) & ~((size_t)getpagesize() - 1);
+        int fd = memfd_create("malloc_3_clone", MFD_CLOEXEC);
+        if(fd == -1){
+            return false;
+        }
+        size_t written = 0;
+        while(ftruncate(fd, length) == 0 && written < length){
+            ssize_t n = write(fd, (char*)p + written, length - written);
+            if(n <= 0){
+                break;
+            }
+            written += n;
+        }
+        if(written < length || mmap(p, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED){
+            close(fd);
+            return false;
+        }
+        p->fd = fd;
+        return true;
+    }
+
+    // a private mapping of the block's file, plus the pages the block has
+    // written since (anonymous pages in /proc/self/pagemap). Without pagemap
+    // every page is copied
+    MallocMetadata* cloneBlock(MallocMetadata* p){
+        if(p->fd == -1 && !freezeBlock(p)){
+            return nullptr;
+        }
+        size_t page = getpagesize();
+        size_t pages = (BYTE_SIZE + p->size + page - 1) / page;
+        int fd = dup(p->fd);
+        if(fd == -1){
+            return nullptr;
+        }
+        char* clone = (char*)mmap(nullptr, pages * page, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if(clone == MAP_FAILED){
+            close(fd);
+            return nullptr;
+        }
+        int pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+        uint64_t entries[512];
+        for(size_t i = 0; i < pages; i += 512){
+            size_t count = pages - i < 512 ? pages - i : 512;
+            off_t offset = ((size_t)p / page + i) * sizeof(uint64_t);
+            bool known = pagemap != -1 &&
+                         pread(pagemap, entries, count * sizeof(uint64_t), offset) == (ssize_t)(count * sizeof(uint64_t));
+            for(size_t j = 0; j < count; j++){
+                // present (bit 63) or swapped (bit 62) and not a file page (bit 61)
+                bool dirty = !known || ((entries[j] >> 62) && !(entries[j] >> 61 & 1));
+                if(dirty){
+                    memcpy(clone + (i + j) * page, (char*)p + (i + j) * page, page);
+                }
+            }
+        }
+        if(pagemap != -1){
+            close(pagemap);
+        }
+        MallocMetadata* ret = (MallocMetadata*)clone;
+        addMmapped(ret, p->size, fd);
+        return ret;
+    }
+
+    MallocMetadata* buddyOf(MallocMetadata* p, int order){
+        return (MallocMetadata*)(base + buddyOffset((char*)p - base, order));
+    }
+
+    // a headerless aligned block has user data where the header would be
+    bool isFreeBlock(MallocMetadata* p, int order){
+        return alignedOrder(p) == -1 && p->is_free && p->size == (size_t)orders[order] - BYTE_SIZE;
+    }
+
+    // returns a block to the free lists, merging it with its buddy for as long
+    // as the buddy is a free block of the same order
+    void freeBlock(MallocMetadata* metaPtr, int order){
+        while(order < MAX_ORDER){
+            MallocMetadata* buddy = buddyOf(metaPtr, order);
+            if(!isFreeBlock(buddy, order)){
+                break;
+            }
+            remove(buddy, order);
+            if(buddy < metaPtr){
+                metaPtr = buddy;
+            }
+            order++;
+        }
+        insert(metaPtr, order);
+    }
+
+    // grows a used block in place to target: the block has to be the lower
+    // half at every order on the way and each upper buddy a whole free block
+    bool expandBlock(MallocMetadata* metaPtr, int target){
+        int order = getOrder(metaPtr->size);
+        if(target > MAX_ORDER){
+            return false;
+        }
+        for(int i = order; i < target; i++){
+            MallocMetadata* buddy = buddyOf(metaPtr, i);
+            if(buddy < metaPtr || !isFreeBlock(buddy, i)){
+                return false;
+            }
+        }
+        for(int i = order; i < target; i++){
+            remove(buddyOf(metaPtr, i), i);
+        }
+        num_used_bytes += orders[target] - orders[order];
+        metaPtr->size = orders[target] - BYTE_SIZE;
+        return true;
+    }
+
+    // the opposite of expandBlock: the block keeps its lower part of target's
+    // size and each upper half on the way down becomes a free block. Their
+    // buddies are the part still in use, so there is nothing to merge.
+    // Returns false if the block already was of target's order
+    bool shrinkBlock(MallocMetadata* metaPtr, int target){
         int order = getOrder(metaPtr->size);
-        insert(metaPtr,order);
+        for(int i = order - 1; i >= target; i--){
+            MallocMetadata* right = (MallocMetadata*)((char*)metaPtr + orders[i]);
+            right->buddy = metaPtr;
+            insert(right, i);
+        }
+        if(target >= order){
+            return false;
+        }
+        num_used_bytes -= orders[order] - orders[target];
+        metaPtr->size = orders[target] - BYTE_SIZE;
+        return true;
+    }
 
-        if(order == MAX_ORDER){
+    void* allocate(size_t size){
+        if(size == 0 || size > 1e8){
             return nullptr;
         }
-//        if(metaPtr->next && (metaPtr->buddy == metaPtr->next || metaPtr->next->buddy == metaPtr)){
-        if(metaPtr->next && metaPtr->next->buddy &&
-           (metaPtr->buddy == metaPtr->next || metaPtr->next->buddy == metaPtr)){
-            remove(metaPtr->next,order);
-            remove(metaPtr,order);
-            insert(metaPtr, order + 1);
-            return metaPtr;
+        void* ret;
+        if(size + BYTE_SIZE <= MMAP_TREHSHOLD){
+            ret = searchBlock(size);
+        } else{
+            ret = mmapBlock(size);
         }
-        if(metaPtr->prev && (metaPtr->buddy == metaPtr->prev)){
-            metaPtr = metaPtr->prev; //TODO: be carefull from bugs here
-            remove(metaPtr->next,order);
-            remove(metaPtr,order);
-            insert(metaPtr, order + 1);
-            return metaPtr;
+        if (ret) {
+            MallocMetadata* metaPtr = (MallocMetadata*)((char*)ret-BYTE_SIZE);
+            num_used_blocks++;
+            num_used_bytes += metaPtr->size;
         }
+        return ret;
+    }
 
-        return nullptr;
+    // headerless aligned blocks are counted like regular blocks of their order
+    void freeAligned(void* p, int order){
+        aligned_orders[((char*)p - base) / orders[0]] = 0;
+        num_used_bytes -= orders[order] - BYTE_SIZE;
+        num_used_blocks--;
+        freeBlock((MallocMetadata*)p, order);
+    }
+
+    void release(void* p){
+        if(!p){
+            return;
+        }
+        int aligned_order = alignedOrder(p);
+        if(aligned_order != -1){
+            freeAligned(p, aligned_order);
+            return;
+        }
+        MallocMetadata* metaPtr = (MallocMetadata*)((char*)p-BYTE_SIZE);
+        if(metaPtr->is_free){
+            return;
+        }
+        size_t original_size = metaPtr->size;
+        //TODO: add checks if free fails
+        num_used_bytes -= original_size; // a block of original size is definitely not used anymore
+        num_used_blocks--;
+        if(metaPtr->is_mmap){
+            ummapBlock(metaPtr);
+            return;
+        }
+        freeBlock(metaPtr, getOrder(original_size));
+    }
+
+    // unmaps every mmap'd block still in use, the arenas are the caller's
+    void releaseMmapped(){
+        while(mmapHead){
+            ummapBlock(mmapHead);
+        }
     }
 
 };
@@ -287,6 +914,21 @@ struct BuddyAllocator{
 BuddyAllocator ba;
 bool smalloc_called = false;
 
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void smalloc_lock(){
+    pthread_mutex_lock(&heap_lock);
+}
+
+void smalloc_unlock(){
+    pthread_mutex_unlock(&heap_lock);
+}
+
+// a child forked while another thread held the lock must not inherit it locked
+__attribute__((constructor)) static void registerForkHandlers(){
+    pthread_atfork(smalloc_lock, smalloc_unlock, smalloc_unlock);
+}
+
 size_t _num_free_blocks(){
 
     return ba.num_free_blocks;
@@ -315,46 +957,61 @@ void* smalloc(size_t size){
         ba.init();
     }
     smalloc_called = true;
-    if(size == 0 || size > 1e8){
-        return nullptr;
+    return ba.allocate(size);
+}
+
+// smalloc<N> lands here with the order already known: a free block of the
+// order is popped directly and only a miss goes through takeBlock
+void* smalloc_order(int order){
+    if(!smalloc_called){
+        ba.init();
     }
-    void* ret;
-    if(size + BYTE_SIZE <= MMAP_TREHSHOLD){
-        ret = ba.searchBlock(size);
+    smalloc_called = true;
+    MallocMetadata* ret = ba.array[order];
+    if(ret){
+        ba.remove(ret, order);
     } else{
-        ret = ba.mmapBlock(size);
-    }
-    if (ret) {
-        MallocMetadata* metaPtr = (MallocMetadata*)((char*)ret-BYTE_SIZE);
-        ba.num_used_blocks++;
-        ba.num_used_bytes += metaPtr->size;
-//        if(!metaPtr->is_mmap){ PROBABLY NOT NEEDED BECAUSE IT HAPPENS IN REMOVE
-//            ba.num_free_bytes -= metaPtr->size;
-//        }
+        ret = ba.takeBlock(order);
+        if(!ret){
+            return nullptr;
+        }
     }
-    return ret;
+    ba.num_used_blocks++;
+    ba.num_used_bytes += ret->size;
+    return (char*)ret + BYTE_SIZE;
 }
 
 void sfree(void* p){
+    ba.release(p);
+}
+
+void sfree_order(void* p, int order){
+    ba.num_used_bytes -= ba.orders[order] - BYTE_SIZE;
+    ba.num_used_blocks--;
+    ba.freeBlock((MallocMetadata*)((char*)p-BYTE_SIZE), order);
+}
+
+// free for callers that know the size they passed to smalloc (sized delete):
+// the order comes from the size, so the block's own header is never read
+void sfree_sized(void* p, size_t size){
     if(!p){
         return;
     }
-    MallocMetadata* metaPtr = (MallocMetadata*)((char*)p-BYTE_SIZE);
-    if(metaPtr->is_free){
+    int aligned_order = ba.alignedOrder(p);
+    if(aligned_order != -1){
+        ba.freeAligned(p, aligned_order);
         return;
     }
-    size_t original_size = metaPtr->size;
-    //TODO: add checks if free fails
-    ba.num_used_bytes -= original_size; // a block of original size is definitely not used anymore
-    ba.num_used_blocks--;
+    // mmap'd blocks need the header for their list links, and srealloc may
+    // have left one below the threshold, where size would look like an order
+    MallocMetadata* metaPtr = (MallocMetadata*)((char*)p-BYTE_SIZE);
     if(metaPtr->is_mmap){
-        ba.ummapBlock(metaPtr);
+        sfree(p);
         return;
     }
-    // ba.num_free_bytes += original_size; //TODO: number of free bytes should change according to successful unions
-    while (metaPtr){
-        metaPtr = ba.uniteBlocks(metaPtr);
-    };
+    int order = ba.getOrder(size);
+    assert(!metaPtr->is_free && size <= metaPtr->size && order == ba.getOrder(metaPtr->size));
+    sfree_order(p, order);
 }
 
 void* scalloc(size_t num, size_t size){
@@ -382,41 +1039,418 @@ void* srealloc(void* oldp, size_t size){
         return nullptr;
     }
 
+    int aligned_order = ba.alignedOrder(oldp);
+    if(aligned_order != -1){
+        size_t old_size = ba.orders[aligned_order];
+        if(old_size >= size){
+            return oldp;
+        }
+        void* ret = smalloc(size);
+        if(!ret){
+            return nullptr;
+        }
+        memmove(ret, oldp, old_size);
+        sfree(oldp);
+        return ret;
+    }
+
     MallocMetadata* tmp = (MallocMetadata*)((char*)oldp - BYTE_SIZE);
+    unsigned short grows = tmp->grows;
+    // a block that keeps growing past the threshold gets twice what it asks
+    // for, so the next grows land in the headroom or are one mremap away
+    bool headroom = grows >= SREALLOC_HEADROOM_GROWS;
+    if(tmp->is_mmap && size + BYTE_SIZE > MMAP_TREHSHOLD){
+        if(size > 1e8){
+            return nullptr;
+        }
+        size_t old_size = tmp->size;
+        if(headroom && size <= old_size && size > old_size / 2){
+            return oldp;
+        }
+        size_t capacity = size;
+        if(headroom && size > old_size){
+            capacity = 2 * old_size > 1e8 ? 100000000 : 2 * old_size;
+            capacity = capacity > size ? capacity : size;
+        }
+        MallocMetadata* resized = ba.remapBlock(tmp, capacity);
+        if(!resized){
+            return nullptr;
+        }
+        // a big shrink means the block stopped growing
+        resized->grows = size > old_size ? grows + 1 : 0;
+        return (char*)resized + BYTE_SIZE;
+    }
+    // shrinking below the threshold moves to a buddy block, or stays put if there is none
+    if(tmp->is_mmap){
+        void* ret = smalloc(size);
+        if(!ret){
+            return oldp;
+        }
+        memmove(ret, oldp, size);
+        sfree(oldp);
+        return ret;
+    }
 //    ba.array;
     if(tmp->size >= size && size > 0){
-        tmp->is_free = false;
-//         tmp->size = size; //TODO: check if we need to change it
+        // the upper halves that size doesn't need go back to the free lists
+        if(ba.shrinkBlock(tmp, ba.getOrder(size))){
+            tmp->grows = 0;
+        }
         return oldp;
     }
     size_t old_size = tmp->size;
 
-    while (tmp){
-        if(tmp->size>= size){
-            break;
+    // grows in place when the upper buddies are free, otherwise moves
+    int order = ba.getOrder(size);
+    if(order != -1 && ba.expandBlock(tmp, order)){
+        tmp->grows = grows + 1;
+        return oldp;
+    }
+
+    // crossing the threshold: the mmap'd block starts out with headroom
+    size_t capacity = 2 * old_size > size ? 2 * old_size : size;
+    if(headroom && capacity + BYTE_SIZE > MMAP_TREHSHOLD && capacity <= 1e8){
+        void* ret = ba.mmapBlock(capacity);
+        if(ret){
+            ba.num_used_blocks++;
+            ba.num_used_bytes += capacity;
+            memmove(ret, oldp, old_size);
+            sfree(oldp);
+            ((MallocMetadata*)((char*)ret - BYTE_SIZE))->grows = grows + 1;
+            return ret;
         }
-        tmp = ba.uniteBlocks(tmp);
-    };
+    }
+
+    void* ret = smalloc(size);
+    if(!ret){
+        return nullptr;
+    }
+    memmove(ret, oldp, old_size);
+    sfree(oldp);
+    ((MallocMetadata*)((char*)ret - BYTE_SIZE))->grows = grows + 1;
+    return ret;
+}
 
+// srealloc without the move: the block grows in place or nothing changes
+bool sexpand(void* p, size_t new_size){
+    if(!p || new_size > 1e8){
+        return false;
+    }
+    if(susable_size(p) >= new_size){
+        return true;
+    }
+    if(ba.alignedOrder(p) != -1){
+        return false;
+    }
+    MallocMetadata* metaPtr = (MallocMetadata*)((char*)p - BYTE_SIZE);
+    if(metaPtr->is_mmap){
+        return ba.remapBlock(metaPtr, new_size, false) != nullptr;
+    }
+    int order = ba.getOrder(new_size);
+    return order != -1 && ba.expandBlock(metaPtr, order);
+}
+
+void* saligned_alloc(size_t alignment, size_t size){
+    if(!smalloc_called){
+        ba.init();
+    }
+    smalloc_called = true;
+    if(size == 0 || size > 1e8 || (alignment & (alignment - 1))){
+        return nullptr;
+    }
+    if(alignment <= ALIGNMENT){
+        return smalloc(size);
+    }
     void* ret;
-    if(tmp){
-        int order = ba.getOrder(tmp->size);
-        ba.remove(tmp, order);
-        // ba.num_used_blocks++;
-        ba.num_used_bytes -= old_size;
-        ba.num_used_bytes += tmp->size;
-        ret = (char*)tmp + BYTE_SIZE;
-        memmove(ret, oldp, old_size);
+    if(size <= MMAP_TREHSHOLD && alignment <= MMAP_TREHSHOLD){
+        ret = ba.alignedBlock(size, alignment);
+        if(ret){
+            ba.num_used_blocks++;
+            ba.num_used_bytes += ba.orders[ba.alignedOrder(ret)] - BYTE_SIZE;
+        }
         return ret;
+    }
+    ret = ba.mmapAlignedBlock(size, alignment);
+    if(ret){
+        ba.num_used_blocks++;
+        ba.num_used_bytes += size;
+    }
+    return ret;
+}
 
+// bytes the caller can actually use: a buddy block is rounded up to its order
+size_t susable_size(void* p){
+    if(!p){
+        return 0;
+    }
+    int aligned_order = ba.alignedOrder(p);
+    if(aligned_order != -1){
+        return ba.orders[aligned_order];
     }
+    return ((MallocMetadata*)((char*)p - BYTE_SIZE))->size;
+}
 
-    ret = smalloc(size);
-    if(!ret){
+void* smalloc_capacity(size_t size, size_t* capacity){
+    void* ret = smalloc(size);
+    if(capacity){
+        *capacity = susable_size(ret);
+    }
+    return ret;
+}
+
+size_t smalloc_batch(size_t size, size_t n, void** out){
+    if(!smalloc_called){
+        ba.init();
+    }
+    smalloc_called = true;
+    if(size == 0 || size > 1e8){
+        return 0;
+    }
+    size_t taken = 0;
+    if(size + BYTE_SIZE <= MMAP_TREHSHOLD){
+        int order = ba.getOrder(size);
+        taken = ba.takeBlocks(order, n, out);
+        ba.num_used_blocks += taken;
+        ba.num_used_bytes += taken * (ba.orders[order] - BYTE_SIZE);
+        return taken;
+    }
+    for(; taken < n; taken++){
+        out[taken] = ba.mmapBlock(size);
+        if(!out[taken]){
+            break;
+        }
+        ba.num_used_blocks++;
+        ba.num_used_bytes += size;
+    }
+    return taken;
+}
+
+// sorted by address, a block's buddy is always the last block still pending,
+// so the sorted copy doubles as a stack of merged blocks and each merged
+// block goes through the free lists only once
+static void freeSorted(void** ptrs, size_t n){
+    size_t top = 0;
+    void* last = nullptr;
+    for(size_t i = 0; i < n; i++){
+        void* p = ptrs[i];
+        if(!p || p == last){
+            continue;
+        }
+        last = p;
+        int aligned_order = ba.alignedOrder(p);
+        if(aligned_order != -1){
+            ba.freeAligned(p, aligned_order);
+            continue;
+        }
+        MallocMetadata* metaPtr = (MallocMetadata*)((char*)p-BYTE_SIZE);
+        if(metaPtr->is_free){
+            continue;
+        }
+        if(metaPtr->is_mmap){
+            sfree(p);
+            continue;
+        }
+        ba.num_used_bytes -= metaPtr->size;
+        ba.num_used_blocks--;
+        int order = ba.getOrder(metaPtr->size);
+        while(top && order < MAX_ORDER){
+            MallocMetadata* pending = (MallocMetadata*)ptrs[top - 1];
+            if(pending->size != metaPtr->size || ba.buddyOf(pending, order) != metaPtr){
+                break;
+            }
+            top--;
+            metaPtr = pending;
+            order++;
+            metaPtr->size = ba.orders[order] - BYTE_SIZE;
+        }
+        ptrs[top++] = metaPtr;
+    }
+    for(size_t i = 0; i < top; i++){
+        MallocMetadata* metaPtr = (MallocMetadata*)ptrs[i];
+        ba.freeBlock(metaPtr, ba.getOrder(metaPtr->size));
+    }
+}
+
+// ptrs is left alone: it is copied and sorted a chunk at a time on the stack,
+// blocks whose buddies are in different chunks merge through the free lists
+void sfree_batch(void* const* ptrs, size_t n){
+    void* sorted[SFREE_BATCH_CHUNK];
+    for(size_t start = 0; start < n; start += SFREE_BATCH_CHUNK){
+        size_t count = min(n - start, (size_t)SFREE_BATCH_CHUNK);
+        copy(ptrs + start, ptrs + start + count, sorted);
+        sort(sorted, sorted + count);
+        freeSorted(sorted, count);
+    }
+}
+
+bool smalloc_set_max_arenas(int arenas){
+    if(arenas < ba.num_arenas || arenas < NUM_ARENAS || arenas > RESERVED_ARENAS){
+        return false;
+    }
+    ba.max_arenas = arenas;
+    return true;
+}
+
+void smalloc_set_address_ordered(bool ordered){
+    ba.address_ordered = ordered;
+}
+
+void* smalloc_mmap(size_t size, size_t alignment){
+    if(size == 0 || size > (size_t)-1 / 2 || alignment > (size_t)-1 / 2 || (alignment & (alignment - 1))){
         return nullptr;
     }
-    memmove(ret, oldp, old_size);
-    sfree(oldp);
+    void* ret;
+    if(alignment <= ALIGNMENT){
+        ret = ba.mmapBlock(size);
+    } else{
+        ret = ba.mmapAlignedBlock(size, alignment);
+    }
+    if(ret){
+        ba.num_used_blocks++;
+        ba.num_used_bytes += size;
+    }
+    return ret;
+}
+
+bool smalloc_use_provider(SProvider* provider){
+    if(smalloc_called || !provider){
+        return false;
+    }
+    heap_provider = provider;
+    return true;
+}
+
+// a heap of its own: the allocator state and the arenas come from the
+// heap's provider instead of ba and the sbrk heap, so sheap_destroy gives
+// back everything the heap holds at once
+struct SHeap{
+    BuddyAllocator heap;
+    unsigned char aligned_orders[NUM_GRANULES] = {};
+    SProvider* provider = nullptr;
+    char* arenas = nullptr;
+    size_t arenas_size = 0;
+};
+
+SHeap* sheap_create_with(SProvider* provider, size_t size){
+    if(!provider || size == 0 || size > NUM_ARENAS * MMAP_TREHSHOLD){
+        return nullptr;
+    }
+    int arenas = (size + MMAP_TREHSHOLD - 1) / MMAP_TREHSHOLD;
+    size_t arenas_size = arenas * MMAP_TREHSHOLD;
+    char* start = (char*)provider->acquire(provider, arenas_size, MMAP_TREHSHOLD);
+    if(!start){
+        return nullptr;
+    }
+    void* mem = provider->acquire(provider, sizeof(SHeap), alignof(SHeap));
+    if(!mem){
+        provider->release(provider, start, arenas_size);
+        return nullptr;
+    }
+    SHeap* heap = new (mem) SHeap();
+    heap->heap.aligned_orders = heap->aligned_orders;
+    heap->heap.max_arenas = arenas;
+    heap->heap.provider = provider;
+    heap->heap.initArenas(start, arenas);
+    heap->provider = provider;
+    heap->arenas = start;
+    heap->arenas_size = arenas_size;
+    return heap;
+}
+
+SHeap* sheap_create(size_t size){
+    return sheap_create_with(&mmap_provider, size);
+}
+
+void* sheap_alloc(SHeap* heap, size_t size){
+    return heap->heap.allocate(size);
+}
+
+void sheap_free(SHeap* heap, void* p){
+    heap->heap.release(p);
+}
+
+void sheap_destroy(SHeap* heap){
+    if(!heap){
+        return;
+    }
+    heap->heap.releaseMmapped();
+    SProvider* provider = heap->provider;
+    char* arenas = heap->arenas;
+    size_t arenas_size = heap->arenas_size;
+    // the state was acquired last, so it goes back first
+    provider->release(provider, heap, sizeof(SHeap));
+    provider->release(provider, arenas, arenas_size);
+}
+
+// the same memfd pages mapped twice, back to back, so ring[i] and
+// ring[i + size] are the same byte and a record that wraps past the end can
+// still be read and written as one span
+void* sring_alloc(size_t size){
+    if(size == 0 || size % getpagesize()){
+        return nullptr;
+    }
+    int fd = memfd_create("malloc_3_ring", MFD_CLOEXEC);
+    if(fd == -1){
+        return nullptr;
+    }
+    char* ring = nullptr;
+    if(ftruncate(fd, size) == 0){
+        // both halves are reserved first so nothing else can land in the second one
+        char* p = (char*)mmap(nullptr, 2 * size, PROT_NONE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(p != MAP_FAILED){
+            if(mmap(p, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED &&
+               mmap(p + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED){
+                ring = p;
+            } else{
+                munmap(p, 2 * size);
+            }
+        }
+    }
+    close(fd);
+    return ring;
+}
+
+void sring_free(void* ring, size_t size){
+    if(ring){
+        munmap(ring, 2 * size);
+    }
+}
+
+// a copy of the block at p. Big mmap'd blocks are copy on write: the first
+// clone moves the block into a memfd (one copy), every clone after that only
+// maps the file and copies the pages the source wrote since
+void* sclone(void* p){
+    if(!p){
+        return nullptr;
+    }
+    void* ret;
+    size_t size;
+    int aligned_order = ba.alignedOrder(p);
+    MallocMetadata* metaPtr = (MallocMetadata*)((char*)p - BYTE_SIZE);
+    if(aligned_order != -1){
+        size = ba.orders[aligned_order];
+        ret = saligned_alloc(size, size);
+    } else if(!metaPtr->is_mmap){
+        size = metaPtr->size;
+        ret = smalloc(size);
+    } else if((size_t)metaPtr % getpagesize() == 0){
+        MallocMetadata* clone = ba.cloneBlock(metaPtr);
+        if(!clone){
+            return nullptr;
+        }
+        ba.num_used_blocks++;
+        ba.num_used_bytes += clone->size;
+        return (char*)clone + BYTE_SIZE;
+    } else{
+        // an aligned mmap'd block: keep at least the alignment it has
+        size = metaPtr->size;
+        size_t alignment = (size_t)p & -(size_t)p;
+        ret = saligned_alloc(alignment < (1 << 30) ? alignment : (1 << 30), size);
+    }
+    if(ret){
+        memcpy(ret, p, size);
+    }
     return ret;
 }
 
@@ -431,4 +1465,4 @@ void* srealloc(void* oldp, size_t size){
 //    ba.array;
 //    return 0;
 //
-//}
\ No newline at end of file
+//}
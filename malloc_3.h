@@ -0,0 +1,176 @@
+//
+// Public interface of the buddy allocator in malloc_3.cpp.
+//
+#ifndef MALLOC_3_H
+#define MALLOC_3_H
+
+#include <stddef.h>
+
+void* smalloc(size_t size);
+void* scalloc(size_t num, size_t size);
+void sfree(void* p);
+void* srealloc(void* oldp, size_t size);
+
+// grows p in place to at least new_size; false (and p untouched) if that
+// would need a move
+bool sexpand(void* p, size_t new_size);
+
+// size must be the size the block was allocated with. Free buddy blocks
+// that srealloc has resized with sfree; mmap'd blocks are always recognized
+void sfree_sized(void* p, size_t size);
+
+// alignment must be a power of two; up to 128KB the block is the naturally
+// aligned buddy block that fits both, above that it is an aligned mmap.
+// Freed with sfree
+void* saligned_alloc(size_t alignment, size_t size);
+
+// a block's real capacity, at least what was asked for; srealloc up to it
+// never moves the block
+size_t susable_size(void* p);
+void* smalloc_capacity(size_t size, size_t* capacity);
+
+// allocates up to n blocks of size into out, returns how many it got.
+// sfree_batch frees n blocks, ptrs itself is not changed
+size_t smalloc_batch(size_t size, size_t n, void** out);
+void sfree_batch(void* const* ptrs, size_t n);
+
+// smalloc<N>() / sfree<N>(p) for constant sizes: the order, or the mmap path
+// above the threshold, is worked out at compile time. sfree<N> only takes
+// blocks from smalloc<N> with the same N
+const size_t SMALLOC_META_DATA_SIZE = 48;
+
+constexpr int smalloc_order_for(size_t size, int order = 0){
+    return order > 10 ? -1 :
+           ((size_t)128 << order) >= size + SMALLOC_META_DATA_SIZE ? order : smalloc_order_for(size, order + 1);
+}
+
+void* smalloc_order(int order);
+void sfree_order(void* p, int order);
+
+template <size_t N>
+void* smalloc(){
+    static_assert(N > 0 && N <= 100000000, "smalloc<N> needs 0 < N <= 1e8");
+    constexpr int order = smalloc_order_for(N);
+    if(order == -1){
+        return smalloc(N);
+    }
+    return smalloc_order(order);
+}
+
+template <size_t N>
+void sfree(void* p){
+    constexpr int order = smalloc_order_for(N);
+    if(order == -1 || !p){
+        sfree(p);
+        return;
+    }
+    sfree_order(p, order);
+}
+
+// where heap arenas come from. acquire returns size bytes aligned to
+// alignment (a power of two) or nullptr, release gives them back
+struct SProvider{
+    void* (*acquire)(SProvider* provider, size_t size, size_t alignment);
+    void (*release)(SProvider* provider, void* p, size_t size);
+};
+
+SProvider* sprovider_sbrk();
+SProvider* sprovider_mmap();
+// hugetlb pages, or transparent huge pages when none are reserved
+SProvider* sprovider_hugetlb();
+SProvider* sprovider_memfd();
+// a PROT_NONE reservation of capacity bytes, committed as it is handed out
+SProvider* sprovider_reserved(size_t capacity);
+// the provider's own state is kept at the start of buffer
+SProvider* sprovider_fixed(void* buffer, size_t size);
+
+// only before the first allocation from the global heap. The default is a
+// PROT_NONE reservation with the arenas committed in place
+bool smalloc_use_provider(SProvider* provider);
+
+// lets the global heap grow past its 32 arenas, one arena per miss, as long
+// as the provider gives out the address range right after the last arena.
+// SMALLOC_MAX_ARENAS (1GB) is all the default reservation has room for
+const int SMALLOC_MAX_ARENAS = 8192;
+bool smalloc_set_max_arenas(int arenas);
+
+// whether the free lists are kept sorted by address (the default), so a
+// split always takes the lowest free block. Inserts walk the list, which
+// gets slow with the number of free blocks a whole program leaves behind;
+// unordered lists push to the front. Lists already built keep their order
+void smalloc_set_address_ordered(bool ordered);
+
+// a block of any size straight from mmap, past smalloc's 1e8 limit.
+// alignment is a power of two. Freed with sfree
+void* smalloc_mmap(size_t size, size_t alignment);
+
+// the heap itself takes no lock. Everything that shares the global heap
+// between threads (operator new, the preload shim, BuddyResource and
+// ObjectPool) takes this one around its calls. A child forked while another
+// thread held it starts with it unlocked
+void smalloc_lock();
+void smalloc_unlock();
+
+struct SHeapLock{
+    SHeapLock(){
+        smalloc_lock();
+    }
+    ~SHeapLock(){
+        smalloc_unlock();
+    }
+};
+
+// a copy of a block, freed with sfree. Blocks above the mmap threshold are
+// cloned copy on write through a memfd instead of copied
+void* sclone(void* p);
+
+// a ring buffer of size bytes (a multiple of the page size) mapped twice in
+// a row: ring[i] and ring[i + size] alias, so wrapped records are contiguous.
+// sring_free takes the same size
+void* sring_alloc(size_t size);
+void sring_free(void* ring, size_t size);
+
+// independent heaps of up to 32 arenas (4MB) with their own free lists;
+// sheap_destroy releases the whole heap, including blocks never freed.
+// sheap_create takes its memory from sprovider_mmap
+struct SHeap;
+SHeap* sheap_create(size_t size);
+SHeap* sheap_create_with(SProvider* provider, size_t size);
+void* sheap_alloc(SHeap* heap, size_t size);
+void sheap_free(SHeap* heap, void* p);
+void sheap_destroy(SHeap* heap);
+
+// a buddy heap in a memory-mapped file that keeps its contents across
+// restarts (malloc_3_persistent.cpp). Structures in it link with offsets:
+// pheap_offset(heap, nullptr) is 0 and pheap_at(heap, 0) is nullptr.
+// Blocks are at most 128KB minus the header and the file never grows past
+// the size it was created with. A heap that wasn't closed is refused by
+// pheap_open; pheap_recover rebuilds its free lists from the block headers
+struct PHeap;
+PHeap* pheap_open(const char* path, size_t size);
+PHeap* pheap_recover(const char* path);
+void pheap_close(PHeap* heap);
+void* pheap_alloc(PHeap* heap, size_t size);
+void pheap_free(PHeap* heap, void* p);
+void* pheap_root(PHeap* heap);
+void pheap_set_root(PHeap* heap, void* p);
+size_t pheap_offset(PHeap* heap, void* p);
+void* pheap_at(PHeap* heap, size_t offset);
+
+// the same heap shared between processes over a memfd or shm_open fd; size
+// is only used by the process that finds the region empty. Offsets and the
+// root slot work as with pheap_
+PHeap* sshm_map(int fd, size_t size);
+PHeap* sshm_open(const char* name, size_t size);
+void sshm_unmap(PHeap* heap);
+void* sshm_alloc(PHeap* heap, size_t size);
+void sshm_free(PHeap* heap, void* p);
+
+size_t _num_free_blocks();
+size_t _num_free_bytes();
+size_t _num_allocated_blocks();
+size_t _num_allocated_bytes();
+size_t _num_meta_data_bytes();
+size_t _size_meta_data();
+
+#endif //MALLOC_3_H
@@ -0,0 +1,157 @@
+//
+// Replaces the global operator new and delete with the buddy allocator in
+// malloc_3.cpp. Link it next to malloc_3.cpp:
+//
+//   g++ -O2 app.cpp malloc_3.cpp malloc_3_new.cpp -pthread
+//
+// Sized delete goes through sfree_sized, which gets the block order from the
+// size the compiler passes instead of reading the block header. Over-aligned
+// types come from saligned_alloc and requests past smalloc's 1e8 limit from
+// smalloc_mmap, like the preload shim serves them. New and delete take the
+// heap lock (smalloc_lock) the shim, BuddyResource and ObjectPool share, so
+// threads can use them. The first new lets the global heap grow to
+// SMALLOC_MAX_ARENAS with unordered free lists. There is no need to add this
+// to the preload shim: libstdc++'s operator new already goes through the
+// shim's malloc.
+//
+#include <new>
+
+#include "malloc_3.h"
+
+// a program's objects, not the 32 arenas the tests use, and more free blocks
+// than the address-ordered lists insert quickly. Called with the lock held
+static void growHeapCap(){
+    static bool grown = false;
+    if(!grown){
+        smalloc_set_max_arenas(SMALLOC_MAX_ARENAS);
+        smalloc_set_address_ordered(false);
+        grown = true;
+    }
+}
+
+static void* allocate(size_t size, size_t alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__){
+    if(size == 0){
+        size = 1;
+    }
+    for(;;){
+        void* p;
+        {
+            SHeapLock lock;
+            growHeapCap();
+            if(size > 1e8){
+                p = smalloc_mmap(size, alignment);
+            } else if(alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__){
+                p = smalloc(size);
+            } else{
+                p = saligned_alloc(alignment, size);
+            }
+        }
+        if(p){
+            return p;
+        }
+        // the handler may free memory itself, so it runs without the lock
+        std::new_handler handler = std::get_new_handler();
+        if(!handler){
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+static void deallocate(void* p) noexcept{
+    SHeapLock lock;
+    sfree(p);
+}
+
+static void deallocateSized(void* p, size_t size) noexcept{
+    SHeapLock lock;
+    sfree_sized(p, size ? size : 1);
+}
+
+static void* allocateNothrow(size_t size, size_t alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__) noexcept{
+    try{
+        return allocate(size, alignment);
+    } catch(...){
+        return nullptr;
+    }
+}
+
+void* operator new(size_t size){
+    return allocate(size);
+}
+
+void* operator new[](size_t size){
+    return allocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{
+    return allocateNothrow(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept{
+    return allocateNothrow(size);
+}
+
+void* operator new(size_t size, std::align_val_t al){
+    return allocate(size, (size_t)al);
+}
+
+void* operator new[](size_t size, std::align_val_t al){
+    return allocate(size, (size_t)al);
+}
+
+void* operator new(size_t size, std::align_val_t al, const std::nothrow_t&) noexcept{
+    return allocateNothrow(size, (size_t)al);
+}
+
+void* operator new[](size_t size, std::align_val_t al, const std::nothrow_t&) noexcept{
+    return allocateNothrow(size, (size_t)al);
+}
+
+void operator delete(void* p) noexcept{
+    deallocate(p);
+}
+
+void operator delete[](void* p) noexcept{
+    deallocate(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept{
+    deallocate(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept{
+    deallocate(p);
+}
+
+void operator delete(void* p, size_t size) noexcept{
+    deallocateSized(p, size);
+}
+
+void operator delete[](void* p, size_t size) noexcept{
+    deallocateSized(p, size);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept{
+    deallocate(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept{
+    deallocate(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept{
+    deallocate(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept{
+    deallocate(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept{
+    deallocate(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept{
+    deallocate(p);
+}
@@ -0,0 +1,421 @@
+//
+// A buddy heap kept in a memory-mapped file, so data structures built in it
+// survive a restart:
+//
+//   PHeap* heap = pheap_open("index.heap", 256 << 20);
+//   Index* index = (Index*)pheap_root(heap);
+//   if(!index){ index = build(heap); pheap_set_root(heap, index); }
+//   ...
+//   pheap_close(heap);
+//
+// The file is mapped at a different address every time, so nothing in it
+// holds a pointer: free-list links and the root are offsets from the start of
+// the file, and structures stored in the heap have to link the same way
+// (pheap_offset / pheap_at). Blocks are the same 128B..128KB buddy blocks as
+// malloc_3.cpp, with the order and buddy math from buddy_order.h; only the
+// free lists link by offset instead of by pointer. There is no mmap path for
+// bigger blocks, so a single
+// allocation is at most 128KB minus the header. The file keeps the size it
+// was created with and never grows.
+//
+// A heap that was not closed cleanly (crash, or still open elsewhere) is
+// refused on open, since its free lists may be half updated. pheap_recover
+// opens it anyway: it walks the block headers arena by arena and rebuilds the
+// free lists and counters from them. A block that was being split or merged
+// at the crash can be lost to the heap, but nothing in use is handed out
+// again. Only recover a heap that no other process has open.
+//
+// The same layout also works as a heap shared between processes: sshm_map
+// maps a memfd or shm_open fd that every process maps on its own, and
+// sshm_alloc / sshm_free take a process-shared mutex kept in the superblock.
+// A producer allocates a message and passes its offset, the consumer reads
+// and frees it in place.
+//
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <pthread.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+
+#include "malloc_3.h"
+#include "buddy_order.h"
+
+#define PHEAP_MAGIC 0x3370616568627562ULL // "bubheap3" on disk
+#define PHEAP_VERSION 1
+#define PHEAP_ARENA BUDDY_ARENA_SIZE
+#define PHEAP_HEADER 4096 // the superblock's page, arenas start after it
+#define PHEAP_MAX_ORDER BUDDY_MAX_ORDER
+
+struct alignas(16) PBlock{
+    uint64_t next;
+    uint64_t prev;
+    uint32_t order;
+    uint32_t is_free;
+};
+
+const uint64_t PBLOCK_SIZE = sizeof(PBlock);
+
+// the superblock at offset 0 of the file, a PHeap* is the start of the mapping
+struct PHeap{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t clean;
+    uint64_t size;
+    uint64_t arenas;
+    uint64_t root;
+    uint64_t free_lists[PHEAP_MAX_ORDER + 1];
+    uint64_t used_blocks;
+    uint64_t used_bytes;
+    pthread_mutex_t lock; // only used by the sshm_ functions
+
+    PBlock* block(uint64_t offset){
+        return (PBlock*)((char*)this + offset);
+    }
+
+    uint64_t offsetOf(void* p){
+        return (char*)p - (char*)this;
+    }
+
+    static uint64_t blockSize(int order){
+        return buddyBlockSize(order);
+    }
+
+    static int getOrder(size_t size){
+        uint64_t tmp = size + PBLOCK_SIZE;
+        if(tmp < PBLOCK_SIZE){
+            return -1;
+        }
+        return buddyOrderFor(tmp);
+    }
+
+    // buddies are found relative to the first arena, like ba.base
+    uint64_t buddyOf(uint64_t offset, int order){
+        return buddyOffset(offset - PHEAP_HEADER, order) + PHEAP_HEADER;
+    }
+
+    void push(uint64_t offset, int order){
+        PBlock* b = block(offset);
+        b->order = order;
+        b->is_free = 1;
+        b->prev = 0;
+        b->next = free_lists[order];
+        if(b->next){
+            block(b->next)->prev = offset;
+        }
+        free_lists[order] = offset;
+    }
+
+    void unlink(uint64_t offset, int order){
+        PBlock* b = block(offset);
+        if(b->prev){
+            block(b->prev)->next = b->next;
+        } else{
+            free_lists[order] = b->next;
+        }
+        if(b->next){
+            block(b->next)->prev = b->prev;
+        }
+        b->is_free = 0;
+    }
+
+    void format(uint64_t file_size, uint64_t num_arenas){
+        memset(this, 0, sizeof(PHeap));
+        magic = PHEAP_MAGIC;
+        version = PHEAP_VERSION;
+        size = file_size;
+        arenas = num_arenas;
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        for(uint64_t i = num_arenas; i > 0; i--){
+            push(PHEAP_HEADER + (i - 1) * PHEAP_ARENA, PHEAP_MAX_ORDER);
+        }
+    }
+
+    // a free block found by recover: merged with its lower buddies, which the
+    // walk has already put back, the upper ones merge with it when reached
+    void reinsert(uint64_t offset, int order){
+        while(order < PHEAP_MAX_ORDER){
+            uint64_t buddy = buddyOf(offset, order);
+            if(buddy > offset || !block(buddy)->is_free || block(buddy)->order != (uint32_t)order){
+                break;
+            }
+            unlink(buddy, order);
+            offset = buddy;
+            order++;
+        }
+        push(offset, order);
+    }
+
+    void recover(){
+        memset(free_lists, 0, sizeof(free_lists));
+        used_blocks = 0;
+        used_bytes = 0;
+        for(uint64_t i = 0; i < arenas; i++){
+            uint64_t arena = PHEAP_HEADER + i * PHEAP_ARENA;
+            uint64_t offset = arena;
+            while(offset < arena + PHEAP_ARENA){
+                PBlock* b = block(offset);
+                // a header that can't be right leaves the rest of the arena out
+                if(b->order > PHEAP_MAX_ORDER || (offset - arena) % blockSize(b->order) != 0){
+                    break;
+                }
+                uint64_t next = offset + blockSize(b->order);
+                if(b->is_free){
+                    reinsert(offset, b->order);
+                } else{
+                    used_blocks++;
+                    used_bytes += blockSize(b->order) - PBLOCK_SIZE;
+                }
+                offset = next;
+            }
+        }
+    }
+
+    void* allocate(size_t size){
+        int order = getOrder(size);
+        if(size == 0 || order == -1){
+            return nullptr;
+        }
+        int i = order;
+        while(i <= PHEAP_MAX_ORDER && !free_lists[i]){
+            i++;
+        }
+        if(i > PHEAP_MAX_ORDER){
+            return nullptr;
+        }
+        uint64_t offset = free_lists[i];
+        unlink(offset, i);
+        while(i > order){
+            i--;
+            push(offset + blockSize(i), i);
+        }
+        block(offset)->order = order;
+        used_blocks++;
+        used_bytes += blockSize(order) - PBLOCK_SIZE;
+        return (char*)block(offset) + PBLOCK_SIZE;
+    }
+
+    void release(void* p){
+        uint64_t offset = offsetOf(p) - PBLOCK_SIZE;
+        PBlock* b = block(offset);
+        if(b->is_free){
+            return;
+        }
+        int order = b->order;
+        used_blocks--;
+        used_bytes -= blockSize(order) - PBLOCK_SIZE;
+        while(order < PHEAP_MAX_ORDER){
+            uint64_t buddy = buddyOf(offset, order);
+            if(!block(buddy)->is_free || block(buddy)->order != (uint32_t)order){
+                break;
+            }
+            unlink(buddy, order);
+            if(buddy < offset){
+                offset = buddy;
+            }
+            order++;
+        }
+        push(offset, order);
+    }
+};
+
+static_assert(sizeof(PHeap) <= PHEAP_HEADER, "the superblock has to fit its page");
+
+// a file pheap_open created is removed again if no heap could be set up in it
+static PHeap* openFailed(const char* path, bool created){
+    if(created){
+        unlink(path);
+    }
+    return nullptr;
+}
+
+PHeap* pheap_open(const char* path, size_t size){
+    // only a size a heap can be made of creates the file
+    bool sized = size != 0 && size <= (size_t)-1 - PHEAP_HEADER - PHEAP_ARENA;
+    int fd = open(path, O_RDWR);
+    bool created = false;
+    if(fd == -1 && errno == ENOENT && sized){
+        fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+        created = fd != -1;
+    }
+    if(fd == -1){
+        return nullptr;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        close(fd);
+        return openFailed(path, created);
+    }
+    bool fresh = st.st_size == 0;
+    uint64_t num_arenas = (size + PHEAP_ARENA - 1) / PHEAP_ARENA;
+    uint64_t file_size = fresh ? PHEAP_HEADER + num_arenas * PHEAP_ARENA : (uint64_t)st.st_size;
+    if((fresh && (!sized || ftruncate(fd, file_size) != 0)) || file_size < PHEAP_HEADER){
+        close(fd);
+        return openFailed(path, created);
+    }
+    void* p = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED){
+        return openFailed(path, created);
+    }
+    PHeap* heap = (PHeap*)p;
+    if(fresh){
+        heap->format(file_size, num_arenas);
+    } else if(heap->magic != PHEAP_MAGIC || heap->version != PHEAP_VERSION ||
+              heap->size != file_size || !heap->clean){
+        munmap(p, file_size);
+        return nullptr;
+    }
+    heap->clean = 0;
+    return heap;
+}
+
+PHeap* pheap_recover(const char* path){
+    int fd = open(path, O_RDWR);
+    if(fd == -1){
+        return nullptr;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (uint64_t)st.st_size < PHEAP_HEADER){
+        close(fd);
+        return nullptr;
+    }
+    uint64_t file_size = st.st_size;
+    void* p = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED){
+        return nullptr;
+    }
+    PHeap* heap = (PHeap*)p;
+    if(heap->magic != PHEAP_MAGIC || heap->version != PHEAP_VERSION || heap->size != file_size ||
+       heap->arenas != (file_size - PHEAP_HEADER) / PHEAP_ARENA){
+        munmap(p, file_size);
+        return nullptr;
+    }
+    heap->recover();
+    if(heap->root >= file_size){
+        heap->root = 0;
+    }
+    heap->clean = 0;
+    return heap;
+}
+
+void pheap_close(PHeap* heap){
+    if(!heap){
+        return;
+    }
+    size_t size = heap->size;
+    heap->clean = 1;
+    msync(heap, size, MS_SYNC);
+    munmap(heap, size);
+}
+
+void* pheap_alloc(PHeap* heap, size_t size){
+    return heap->allocate(size);
+}
+
+void pheap_free(PHeap* heap, void* p){
+    if(p){
+        heap->release(p);
+    }
+}
+
+void* pheap_root(PHeap* heap){
+    return pheap_at(heap, heap->root);
+}
+
+void pheap_set_root(PHeap* heap, void* p){
+    heap->root = pheap_offset(heap, p);
+}
+
+size_t pheap_offset(PHeap* heap, void* p){
+    return p ? heap->offsetOf(p) : 0;
+}
+
+void* pheap_at(PHeap* heap, size_t offset){
+    return offset ? (char*)heap + offset : nullptr;
+}
+
+// the fd is locked while the region is checked, so only the first process to
+// map an empty one formats it
+PHeap* sshm_map(int fd, size_t size){
+    if(flock(fd, LOCK_EX) != 0){
+        return nullptr;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        flock(fd, LOCK_UN);
+        return nullptr;
+    }
+    bool fresh = st.st_size == 0;
+    uint64_t num_arenas = (size + PHEAP_ARENA - 1) / PHEAP_ARENA;
+    uint64_t file_size = fresh ? PHEAP_HEADER + num_arenas * PHEAP_ARENA : (uint64_t)st.st_size;
+    if((fresh && (size == 0 || ftruncate(fd, file_size) != 0)) || file_size < PHEAP_HEADER){
+        flock(fd, LOCK_UN);
+        return nullptr;
+    }
+    void* p = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    PHeap* heap = p == MAP_FAILED ? nullptr : (PHeap*)p;
+    if(heap && fresh){
+        heap->format(file_size, num_arenas);
+    } else if(heap && (heap->magic != PHEAP_MAGIC || heap->version != PHEAP_VERSION ||
+                       heap->size != file_size)){
+        munmap(p, file_size);
+        heap = nullptr;
+    }
+    flock(fd, LOCK_UN);
+    return heap;
+}
+
+PHeap* sshm_open(const char* name, size_t size){
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if(fd == -1){
+        return nullptr;
+    }
+    PHeap* heap = sshm_map(fd, size);
+    close(fd);
+    return heap;
+}
+
+void sshm_unmap(PHeap* heap){
+    if(heap){
+        munmap(heap, heap->size);
+    }
+}
+
+struct SharedLock{
+    PHeap* heap;
+
+    explicit SharedLock(PHeap* heap) : heap(heap){
+        // a process died holding the lock; what it was doing is lost, the
+        // lists are taken as they are
+        if(pthread_mutex_lock(&heap->lock) == EOWNERDEAD){
+            pthread_mutex_consistent(&heap->lock);
+        }
+    }
+
+    ~SharedLock(){
+        pthread_mutex_unlock(&heap->lock);
+    }
+};
+
+void* sshm_alloc(PHeap* heap, size_t size){
+    SharedLock lock(heap);
+    return heap->allocate(size);
+}
+
+void sshm_free(PHeap* heap, void* p){
+    if(!p){
+        return;
+    }
+    SharedLock lock(heap);
+    heap->release(p);
+}
@@ -0,0 +1,167 @@
+//
+// LD_PRELOAD shim that serves malloc/free/calloc/realloc and the aligned
+// variants from the buddy allocator in malloc_3.cpp, so it can be A/B tested
+// against glibc on real binaries:
+//
+//   g++ -O2 -shared -fPIC malloc_3_preload.cpp -o libmalloc_3.so -pthread
+//   LD_PRELOAD=./libmalloc_3.so <binary>
+//
+// The allocator source is included directly (like test.cpp does with
+// malloc_4.h) so the shim can reach ba and the block headers.
+//
+// Every request is served here: requests above smalloc's 1e8 limit go
+// straight to the mmap path and over-aligned ones to saligned_alloc. Nothing
+// is forwarded to glibc, so there is no dlsym(RTLD_NEXT) lookup to bootstrap.
+// Initialization can't recurse either: ba and heap_provider are
+// constant-initialized and the default provider only calls mmap and mprotect.
+// Every entry point takes the heap lock from malloc_3.cpp (smalloc_lock),
+// which also registers the fork handlers for it.
+// The first allocation lifts the heap's cap to the whole reservation, so
+// small blocks aren't limited to the 32 arenas the tests use, and turns off
+// the address-ordered free lists, whose inserts get slow with the number of
+// free blocks a real program leaves behind.
+//
+#include "malloc_3.cpp"
+#include <malloc.h>
+#include <cerrno>
+#include <cstdlib>
+
+// before the heap's first arenas are taken, which may be from another
+// library's constructor, so this can't wait for ours
+static void growHeapCap(){
+    if(!smalloc_called){
+        smalloc_set_max_arenas(RESERVED_ARENAS);
+        smalloc_set_address_ordered(false);
+    }
+}
+
+static void* allocate(size_t size){
+    growHeapCap();
+    if(size == 0){
+        size = 1;
+    }
+    if(size > 1e8){
+        return smalloc_mmap(size, ALIGNMENT);
+    }
+    return smalloc(size);
+}
+
+static void* allocateAligned(size_t alignment, size_t size){
+    growHeapCap();
+    if(alignment <= ALIGNMENT){
+        return allocate(size);
+    }
+    if(size > 1e8){
+        return smalloc_mmap(size, alignment);
+    }
+    return saligned_alloc(alignment, size ? size : 1);
+}
+
+extern "C" {
+
+void* malloc(size_t size) noexcept{
+    SHeapLock lock;
+    void* ret = allocate(size);
+    if(!ret){
+        errno = ENOMEM;
+    }
+    return ret;
+}
+
+void free(void* p) noexcept{
+    SHeapLock lock;
+    sfree(p);
+}
+
+void* calloc(size_t num, size_t size) noexcept{
+    if(size && num > (size_t)-1 / size){
+        errno = ENOMEM;
+        return nullptr;
+    }
+    SHeapLock lock;
+    void* ret = allocate(num * size);
+    if(!ret){
+        errno = ENOMEM;
+        return nullptr;
+    }
+    memset(ret, 0, num * size);
+    return ret;
+}
+
+// up to smalloc's limit this is srealloc, which grows in place when it can;
+// above it the block is allocated + copied + freed
+void* realloc(void* oldp, size_t size) noexcept{
+    SHeapLock lock;
+    if(!oldp){
+        return allocate(size);
+    }
+    if(size == 0){
+        sfree(oldp);
+        return nullptr;
+    }
+    if(size <= 1e8){
+        void* ret = srealloc(oldp, size);
+        if(!ret){
+            errno = ENOMEM;
+        }
+        return ret;
+    }
+    size_t old_size = susable_size(oldp);
+    if(old_size >= size){
+        return oldp;
+    }
+    void* ret = allocate(size);
+    if(!ret){
+        errno = ENOMEM;
+        return nullptr;
+    }
+    memcpy(ret, oldp, old_size);
+    sfree(oldp);
+    return ret;
+}
+
+int posix_memalign(void** memptr, size_t alignment, size_t size) noexcept{
+    if(alignment % sizeof(void*) || (alignment & (alignment - 1))){
+        return EINVAL;
+    }
+    SHeapLock lock;
+    void* ret = allocateAligned(alignment, size);
+    if(!ret){
+        return ENOMEM;
+    }
+    *memptr = ret;
+    return 0;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept{
+    if(alignment == 0 || (alignment & (alignment - 1))){
+        errno = EINVAL;
+        return nullptr;
+    }
+    SHeapLock lock;
+    void* ret = allocateAligned(alignment, size);
+    if(!ret){
+        errno = ENOMEM;
+    }
+    return ret;
+}
+
+void* memalign(size_t alignment, size_t size) noexcept{
+    return aligned_alloc(alignment, size);
+}
+
+void* valloc(size_t size) noexcept{
+    return aligned_alloc(getpagesize(), size);
+}
+
+void* pvalloc(size_t size) noexcept{
+    size_t page = getpagesize();
+    return aligned_alloc(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void* p) noexcept{
+    SHeapLock lock;
+    return susable_size(p);
+}
+
+}
@@ -0,0 +1,364 @@
+//
+// Fixed-size slots for one type, packed into buddy blocks from malloc_3.cpp.
+// A slot has no MallocMetadata of its own, so small objects that are churned
+// a lot (connections, sessions) cost sizeof(T) instead of a 128 byte block:
+//
+//   ObjectPool<Session> sessions;
+//   Session* s = sessions.create(fd);
+//   sessions.destroy(s);
+//
+// ObjectPool<T, true> caches construction: destroy keeps the object
+// constructed and the next create hands it back as it was left, skipping the
+// constructor (create's arguments are then unused). trim() destroys the cache.
+//
+// A pool can be shared between threads. Each thread keeps a magazine of
+// slots (or cached objects) per pool that create and destroy use without a
+// lock; only an empty or full magazine goes to the pool's depot, half a
+// magazine at a time, under the pool's lock. An object may be destroyed by
+// any thread, its slot then goes to that thread's magazine. Slabs, and the
+// magazines themselves, come from the buddy heap under the heap lock
+// (smalloc_lock) that operator new and the preload shim take too.
+//
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#include "malloc_3.h"
+
+// slots a magazine holds: it fills a 256 byte buddy block
+const int POOL_MAGAZINE_SIZE = (256 - SMALLOC_META_DATA_SIZE) / sizeof(void*) - 1;
+// threads that get magazines at once, the rest go through the pool's lock
+const int POOL_MAX_THREADS = 64;
+
+struct PoolThreadIndices{
+    std::mutex lock;
+    bool taken[POOL_MAX_THREADS] = {};
+};
+
+inline PoolThreadIndices& poolThreadIndices(){
+    static PoolThreadIndices indices;
+    return indices;
+}
+
+// a small number for each live thread, -1 past POOL_MAX_THREADS. A thread
+// that exits hands its number, and with it its magazines, to the next one
+struct PoolThreadIndex{
+    int index = -1;
+
+    PoolThreadIndex(){
+        PoolThreadIndices& indices = poolThreadIndices();
+        std::lock_guard<std::mutex> lock(indices.lock);
+        for(int i = 0; i < POOL_MAX_THREADS; i++){
+            if(!indices.taken[i]){
+                indices.taken[i] = true;
+                index = i;
+                return;
+            }
+        }
+    }
+
+    ~PoolThreadIndex(){
+        if(index == -1){
+            return;
+        }
+        PoolThreadIndices& indices = poolThreadIndices();
+        std::lock_guard<std::mutex> lock(indices.lock);
+        indices.taken[index] = false;
+    }
+};
+
+inline int poolThreadIndex(){
+    thread_local PoolThreadIndex id;
+    return id.index;
+}
+
+template <class T, bool Cached>
+struct PoolSlot;
+
+// a free slot keeps the freelist link where the object was
+template <class T>
+struct PoolSlot<T, false>{
+    union{
+        PoolSlot* next;
+        alignas(T) unsigned char object[sizeof(T)];
+    };
+};
+
+// a cached object is still alive, so its link goes after it
+template <class T>
+struct PoolSlot<T, true>{
+    alignas(T) unsigned char object[sizeof(T)];
+    PoolSlot* next;
+};
+
+// data size of the smallest buddy block (from 4KB up) that holds 32 slots,
+// or of the biggest one if none does, but always at least one slot
+constexpr size_t poolSlabSize(size_t slot, size_t header, int order = 5){
+    return order < 10 && ((size_t)128 << order) - SMALLOC_META_DATA_SIZE < header + 32 * slot ?
+           poolSlabSize(slot, header, order + 1) :
+           ((size_t)128 << order) - SMALLOC_META_DATA_SIZE < header + slot ? header + slot :
+           ((size_t)128 << order) - SMALLOC_META_DATA_SIZE;
+}
+
+template <class T, bool Cached = false>
+class ObjectPool{
+    static_assert(alignof(T) <= 16, "buddy blocks are only 16 byte aligned");
+
+    typedef PoolSlot<T, Cached> Slot;
+
+    struct alignas(16) Slab{
+        Slab* next;
+    };
+
+    // a stack: slots[count - 1] goes out next
+    struct Magazine{
+        int count;
+        Slot* slots[POOL_MAGAZINE_SIZE];
+    };
+
+    static const size_t SLAB_SIZE = poolSlabSize(sizeof(Slot), sizeof(Slab));
+
+    std::mutex lock;            // the depot, everything but the magazines
+    Slab* slabs = nullptr;
+    Slot* free_slots = nullptr; // nothing constructed in them
+    Slot* cached = nullptr;     // constructed objects waiting for reuse
+    char* carve = nullptr;      // slots of the newest slab are cut lazily
+    char* carve_end = nullptr;
+    // each is only used by the thread with that index
+    Magazine* magazines[POOL_MAX_THREADS] = {};
+
+    // with the lock held
+    bool newSlab(){
+        Slab* slab;
+        {
+            SHeapLock heap;
+            slab = (Slab*)smalloc<SLAB_SIZE>();
+        }
+        if(!slab){
+            return false;
+        }
+        slab->next = slabs;
+        slabs = slab;
+        carve = (char*)(slab + 1);
+        carve_end = (char*)slab + SLAB_SIZE;
+        return true;
+    }
+
+    bool canCarve(){
+        return carve && carve + sizeof(Slot) <= carve_end;
+    }
+
+    // with the lock held
+    Slot* takeSlot(){
+        if(free_slots){
+            Slot* s = free_slots;
+            free_slots = s->next;
+            return s;
+        }
+        if(!canCarve() && !newSlab()){
+            return nullptr;
+        }
+        Slot* s = (Slot*)carve;
+        carve += sizeof(Slot);
+        return s;
+    }
+
+    // with the lock held
+    void putSlot(Slot* s){
+        s->next = free_slots;
+        free_slots = s;
+    }
+
+    // the calling thread's magazine, nullptr if it can't have one
+    Magazine* magazine(bool create = true){
+        int index = poolThreadIndex();
+        if(index == -1){
+            return nullptr;
+        }
+        Magazine* m = magazines[index];
+        if(!m && create){
+            {
+                SHeapLock heap;
+                m = (Magazine*)smalloc<sizeof(Magazine)>();
+            }
+            if(m){
+                m->count = 0;
+                magazines[index] = m;
+            }
+        }
+        return m;
+    }
+
+    // up to half a magazine from the depot: cached objects for a cached pool,
+    // free slots, or fresh ones cut from the newest slab otherwise. A cached
+    // pool without cached objects constructs in slots taken one at a time
+    void refill(Magazine* m){
+        std::lock_guard<std::mutex> guard(lock);
+        Slot** list = Cached ? &cached : &free_slots;
+        while(*list && m->count < POOL_MAGAZINE_SIZE / 2){
+            m->slots[m->count++] = *list;
+            *list = (*list)->next;
+        }
+        if(Cached || m->count){
+            return;
+        }
+        // a new slab only when the magazine would stay empty
+        while(m->count < POOL_MAGAZINE_SIZE / 2 && (canCarve() || (!m->count && newSlab()))){
+            m->slots[m->count++] = (Slot*)carve;
+            carve += sizeof(Slot);
+        }
+        // the lowest address goes out first
+        std::reverse(m->slots, m->slots + m->count);
+    }
+
+    // a full magazine gives its upper half back to the depot
+    void flush(Magazine* m){
+        std::lock_guard<std::mutex> guard(lock);
+        Slot** list = Cached ? &cached : &free_slots;
+        while(m->count > POOL_MAGAZINE_SIZE / 2){
+            Slot* s = m->slots[--m->count];
+            s->next = *list;
+            *list = s;
+        }
+    }
+
+public:
+    ObjectPool() = default;
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    // objects that were never destroyed are not destructed, only freed. No
+    // other thread may use the pool by then
+    ~ObjectPool(){
+        // before the heap lock, destructors may allocate
+        for(Magazine* m : magazines){
+            while(Cached && m && m->count){
+                ((T*)m->slots[--m->count]->object)->~T();
+            }
+        }
+        while(cached){
+            Slot* s = cached;
+            cached = s->next;
+            ((T*)s->object)->~T();
+        }
+        SHeapLock heap;
+        for(Magazine* m : magazines){
+            if(m){
+                sfree<sizeof(Magazine)>(m);
+            }
+        }
+        while(slabs){
+            Slab* next = slabs->next;
+            sfree<SLAB_SIZE>(slabs);
+            slabs = next;
+        }
+    }
+
+    // nullptr when the heap is out of memory, like smalloc
+    template <class... Args>
+    T* create(Args&&... args){
+        Magazine* m = magazine();
+        if(m && !m->count){
+            refill(m);
+        }
+        Slot* s;
+        if(m && m->count){
+            s = m->slots[--m->count];
+            if(Cached){
+                return (T*)s->object;
+            }
+        } else{
+            std::lock_guard<std::mutex> guard(lock);
+            if(Cached && cached){
+                s = cached;
+                cached = s->next;
+                return (T*)s->object;
+            }
+            s = takeSlot();
+        }
+        if(!s){
+            return nullptr;
+        }
+        try{
+            return new (s->object) T(std::forward<Args>(args)...);
+        } catch(...){
+            std::lock_guard<std::mutex> guard(lock);
+            putSlot(s);
+            throw;
+        }
+    }
+
+    void destroy(T* p){
+        if(!p){
+            return;
+        }
+        Slot* s = (Slot*)p;
+        if(!Cached){
+            p->~T();
+        }
+        Magazine* m = magazine();
+        if(!m){
+            std::lock_guard<std::mutex> guard(lock);
+            if(Cached){
+                s->next = cached;
+                cached = s;
+            } else{
+                putSlot(s);
+            }
+            return;
+        }
+        if(m->count == POOL_MAGAZINE_SIZE){
+            flush(m);
+        }
+        m->slots[m->count++] = s;
+    }
+
+    // destructs the cached objects in the depot and in the calling thread's
+    // magazine, their slots stay in the pool. Other threads' magazines keep
+    // theirs
+    void trim(){
+        if(!Cached){
+            return;
+        }
+        Slot* list = nullptr;
+        Magazine* m = magazine(false);
+        while(m && m->count){
+            Slot* s = m->slots[--m->count];
+            s->next = list;
+            list = s;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            while(cached){
+                Slot* s = cached;
+                cached = s->next;
+                s->next = list;
+                list = s;
+            }
+        }
+        // without the lock, a destructor may destroy other objects of the pool
+        for(Slot* s = list; s; s = s->next){
+            ((T*)s->object)->~T();
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        while(list){
+            Slot* next = list->next;
+            putSlot(list);
+            list = next;
+        }
+    }
+
+    static constexpr size_t slotSize(){
+        return sizeof(Slot);
+    }
+
+    static constexpr size_t slotsPerSlab(){
+        return (SLAB_SIZE - sizeof(Slab)) / sizeof(Slot);
+    }
+};
+
+#endif //OBJECT_POOL_H
@@ -0,0 +1,446 @@
+//
+// Compile-time policy version of the malloc_1/2/3 allocators.
+//
+// PolicyAllocator<Source, Placement, MmapThreshold, LargeSource> keeps all of
+// its state in the instance (no hmd/ba globals) and every choice is a template
+// parameter, so different configurations can be benchmarked side by side with
+// no runtime dispatch:
+//   Source        where the small-block heap gets memory (SbrkSource, MmapSource)
+//   Placement     how blocks are placed; also decides the header layout and the
+//                 size-class table (BumpPlacement, FirstFitPlacement, BuddyPlacement)
+//   MmapThreshold requests whose block would be bigger go to LargeSource (0 = never)
+//
+// Malloc1Allocator, Malloc2Allocator and Malloc3Allocator at the bottom are the
+// configurations that match malloc_1.cpp (chunked bump), malloc_2.cpp (first
+// fit through the size index, wilderness extension) and malloc_3.cpp (buddy
+// arenas, mmap above 128KB). The header layouts are the placements' own.
+//
+#ifndef POLICY_ALLOCATOR_H
+#define POLICY_ALLOCATOR_H
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+#include "first_fit.h"
+
+const size_t POLICY_MAX_ALLOCATION = 100000000;
+const size_t POLICY_ALIGNMENT = 16;
+
+inline size_t policyAlignUp(size_t size){
+    return (size + POLICY_ALIGNMENT - 1) & ~(POLICY_ALIGNMENT - 1);
+}
+
+// ---------------------------------------------------------------- sources
+
+struct SbrkSource{
+    static const bool contiguous = true;
+
+    // keeps the break aligned so consecutive grows stay contiguous
+    static void* grow(size_t size){
+        size_t brk = (size_t)sbrk(0);
+        if(brk != policyAlignUp(brk) && sbrk(policyAlignUp(brk) - brk) == (void*)(-1)){
+            return nullptr;
+        }
+        void* p = sbrk(policyAlignUp(size));
+        return p == (void*)(-1) ? nullptr : p;
+    }
+
+    static void* top(){
+        return sbrk(0);
+    }
+
+    static void release(void*, size_t){
+        // the break is never moved back
+    }
+};
+
+struct MmapSource{
+    static const bool contiguous = false;
+
+    static void* grow(size_t size){
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    static void* top(){
+        return nullptr;
+    }
+
+    static void release(void* p, size_t size){
+        munmap(p, size);
+    }
+};
+
+// ------------------------------------------------------------- placements
+//
+// A placement provides:
+//   struct Header            with at least size, is_free and is_mmap
+//   void* allocate(size)     returns the user pointer right after a Header
+//   void release(Header*)    the block is not mmap'd and not already free
+
+// malloc_1: allocations bump a pointer through chunks that double in size up
+// to MaxChunk, and nothing is reused. A contiguous source extends the
+// current chunk in place, so only a refill enters the kernel. Unlike
+// malloc_1.cpp a block has a header, which sfree and srealloc need.
+template <class Source, size_t FirstChunk = 1024 * 1024, size_t MaxChunk = 64 * 1024 * 1024>
+struct BumpPlacement{
+    struct Header{
+        size_t size;
+        bool is_free;
+        bool is_mmap;
+    };
+
+    char* next = nullptr;
+    char* end = nullptr;
+    size_t chunk_size = FirstChunk;
+
+    bool refill(size_t size){
+        if(Source::contiguous && end && Source::top() == end){
+            size_t missing = size - (end - next);
+            size_t request = policyAlignUp(missing > chunk_size ? missing : chunk_size);
+            if(!Source::grow(request)){
+                return false;
+            }
+            end += request;
+        } else{
+            // the tail of the old chunk is dropped
+            size_t request = policyAlignUp(size > chunk_size ? size : chunk_size);
+            char* chunk = (char*)Source::grow(request);
+            if(!chunk){
+                return false;
+            }
+            next = chunk;
+            end = chunk + request;
+        }
+        if(chunk_size < MaxChunk){
+            chunk_size *= 2;
+        }
+        return true;
+    }
+
+    void* allocate(size_t size){
+        size_t total = policyAlignUp(size + sizeof(Header));
+        if((size_t)(end - next) < total && !refill(total)){
+            return nullptr;
+        }
+        Header* h = (Header*)next;
+        next += total;
+        h->size = size;
+        h->is_free = false;
+        h->is_mmap = false;
+        return h + 1;
+    }
+
+    void release(Header* h){
+        h->is_free = true;
+    }
+};
+
+// malloc_2: first fit over the blocks in address order, no splitting, and a
+// free tail block is extended when the source is contiguous. As in
+// malloc_2.cpp the first-fit query runs over a structure-of-arrays copy of
+// the free sizes (0 for a used block) in mmap'd memory, 8 (AVX2) or 4 (SSE2)
+// blocks per compare, instead of chasing next pointers.
+template <class Source>
+struct FirstFitPlacement{
+    struct alignas(POLICY_ALIGNMENT) Header{
+        size_t size;
+        bool is_free;
+        bool is_mmap;
+        Header* next;
+        Header* prev;
+        size_t index; // position of the block in free_sizes and blocks
+    };
+
+    Header* head = nullptr;
+    Header* tail = nullptr;
+    uint32_t* free_sizes = nullptr;
+    Header** blocks = nullptr;
+    size_t count = 0;
+    size_t capacity = 0;
+
+    bool reserve(){
+        if(count < capacity){
+            return true;
+        }
+        size_t new_capacity = capacity ? capacity * 2 : 1024;
+        uint32_t* sizes = (uint32_t*)MmapSource::grow(new_capacity * sizeof(uint32_t));
+        Header** ptrs = (Header**)MmapSource::grow(new_capacity * sizeof(Header*));
+        if(!sizes || !ptrs){
+            if(sizes){
+                MmapSource::release(sizes, new_capacity * sizeof(uint32_t));
+            }
+            if(ptrs){
+                MmapSource::release(ptrs, new_capacity * sizeof(Header*));
+            }
+            return false;
+        }
+        if(capacity){
+            memcpy(sizes, free_sizes, count * sizeof(uint32_t));
+            memcpy(ptrs, blocks, count * sizeof(Header*));
+            MmapSource::release(free_sizes, capacity * sizeof(uint32_t));
+            MmapSource::release(blocks, capacity * sizeof(Header*));
+        }
+        free_sizes = sizes;
+        blocks = ptrs;
+        capacity = new_capacity;
+        return true;
+    }
+
+    // first index whose free size is >= size, or count if there is none
+    size_t firstFit(size_t size){
+        return firstFitIndex(free_sizes, count, size);
+    }
+
+    void* allocate(size_t size){
+        size = policyAlignUp(size);
+        size_t i = firstFit(size);
+        if(i < count){
+            Header* h = blocks[i];
+            h->is_free = false;
+            free_sizes[i] = 0;
+            return h + 1;
+        }
+        if(Source::contiguous && tail && tail->is_free &&
+           Source::top() == (char*)(tail + 1) + tail->size){
+            if(!Source::grow(size - tail->size)){
+                return nullptr;
+            }
+            tail->size = size;
+            tail->is_free = false;
+            free_sizes[tail->index] = 0;
+            return tail + 1;
+        }
+        if(!reserve()){
+            return nullptr;
+        }
+        Header* h = (Header*)Source::grow(size + sizeof(Header));
+        if(!h){
+            return nullptr;
+        }
+        h->size = size;
+        h->is_free = false;
+        h->is_mmap = false;
+        h->next = nullptr;
+        h->prev = tail;
+        h->index = count;
+        free_sizes[count] = 0;
+        blocks[count] = h;
+        count++;
+        if(tail){
+            tail->next = h;
+        } else{
+            head = h;
+        }
+        tail = h;
+        return h + 1;
+    }
+
+    void release(Header* h){
+        h->is_free = true;
+        free_sizes[h->index] = (uint32_t)h->size;
+    }
+};
+
+// malloc_3: binary buddy system over Arenas blocks of MinBlock << MaxOrder
+// bytes. The size-class table is MinBlock << order, resolved at compile time.
+template <class Source, size_t MinBlock, int MaxOrder, int Arenas>
+struct BuddyPlacement{
+    struct Header{
+        size_t size;
+        bool is_free;
+        bool is_mmap;
+        int order;
+        Header* next;
+        Header* prev;
+    };
+
+    static const size_t ARENA_SIZE = MinBlock << MaxOrder;
+
+    static constexpr size_t blockSize(int order){
+        return MinBlock << order;
+    }
+
+    static constexpr int orderFor(size_t size, int order = 0){
+        return order > MaxOrder ? -1 :
+               blockSize(order) >= size + sizeof(Header) ? order : orderFor(size, order + 1);
+    }
+
+    Header* free_lists[MaxOrder + 1] = {};
+    char* base = nullptr;
+
+    void push(Header* h, int order){
+        h->order = order;
+        h->size = blockSize(order) - sizeof(Header);
+        h->is_free = true;
+        h->is_mmap = false;
+        h->prev = nullptr;
+        h->next = free_lists[order];
+        if(h->next){
+            h->next->prev = h;
+        }
+        free_lists[order] = h;
+    }
+
+    void unlink(Header* h, int order){
+        if(h->prev){
+            h->prev->next = h->next;
+        } else{
+            free_lists[order] = h->next;
+        }
+        if(h->next){
+            h->next->prev = h->prev;
+        }
+        h->is_free = false;
+    }
+
+    bool init(){
+        base = (char*)Source::grow(ARENA_SIZE * Arenas);
+        if(!base){
+            return false;
+        }
+        for(int i = Arenas - 1; i >= 0; i--){
+            push((Header*)(base + i * ARENA_SIZE), MaxOrder);
+        }
+        return true;
+    }
+
+    Header* buddyOf(Header* h, int order){
+        return (Header*)(base + (((char*)h - base) ^ blockSize(order)));
+    }
+
+    void* allocate(size_t size){
+        if(!base && !init()){
+            return nullptr;
+        }
+        int order = orderFor(size);
+        if(order < 0){
+            return nullptr;
+        }
+        int i = order;
+        while(i <= MaxOrder && !free_lists[i]){
+            i++;
+        }
+        if(i > MaxOrder){
+            return nullptr;
+        }
+        Header* h = free_lists[i];
+        unlink(h, i);
+        while(i > order){
+            i--;
+            push((Header*)((char*)h + blockSize(i)), i);
+        }
+        h->order = order;
+        h->size = blockSize(order) - sizeof(Header);
+        h->is_mmap = false;
+        return h + 1;
+    }
+
+    void release(Header* h){
+        int order = h->order;
+        while(order < MaxOrder){
+            Header* buddy = buddyOf(h, order);
+            if(!buddy->is_free || buddy->order != order){
+                break;
+            }
+            unlink(buddy, order);
+            if(buddy < h){
+                h = buddy;
+            }
+            order++;
+        }
+        push(h, order);
+    }
+};
+
+template <class Source>
+using Buddy128Placement = BuddyPlacement<Source, 128, 10, 32>;
+
+// -------------------------------------------------------------- allocator
+
+template <class Source, template <class> class Placement,
+          size_t MmapThreshold = 0, class LargeSource = MmapSource>
+class PolicyAllocator{
+    typedef Placement<Source> PlacementType;
+    typedef typename PlacementType::Header Header;
+
+    PlacementType placement;
+
+    static Header* header(void* p){
+        return (Header*)p - 1;
+    }
+
+public:
+    void* smalloc(size_t size){
+        if(size == 0 || size > POLICY_MAX_ALLOCATION){
+            return nullptr;
+        }
+        if(MmapThreshold && size + sizeof(Header) > MmapThreshold){
+            Header* h = (Header*)LargeSource::grow(size + sizeof(Header));
+            if(!h){
+                return nullptr;
+            }
+            h->size = size;
+            h->is_free = false;
+            h->is_mmap = true;
+            return h + 1;
+        }
+        return placement.allocate(size);
+    }
+
+    void* scalloc(size_t num, size_t size){
+        if(num && size > POLICY_MAX_ALLOCATION / num){
+            return nullptr;
+        }
+        void* ret = smalloc(num * size);
+        if(ret){
+            memset(ret, 0, num * size);
+        }
+        return ret;
+    }
+
+    void sfree(void* p){
+        if(!p){
+            return;
+        }
+        Header* h = header(p);
+        if(h->is_free){
+            return;
+        }
+        if(h->is_mmap){
+            LargeSource::release(h, h->size + sizeof(Header));
+            return;
+        }
+        placement.release(h);
+    }
+
+    void* srealloc(void* oldp, size_t size){
+        if(!oldp){
+            return smalloc(size);
+        }
+        if(size == 0){
+            sfree(oldp);
+            return nullptr;
+        }
+        Header* h = header(oldp);
+        if(h->size >= size){
+            return oldp;
+        }
+        void* ret = smalloc(size);
+        if(!ret){
+            return nullptr;
+        }
+        memmove(ret, oldp, h->size);
+        sfree(oldp);
+        return ret;
+    }
+};
+
+typedef PolicyAllocator<SbrkSource, BumpPlacement> Malloc1Allocator;
+typedef PolicyAllocator<SbrkSource, FirstFitPlacement> Malloc2Allocator;
+typedef PolicyAllocator<SbrkSource, Buddy128Placement, 128 * 1024> Malloc3Allocator;
+
+#endif //POLICY_ALLOCATOR_H
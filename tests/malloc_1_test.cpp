@@ -4,13 +4,16 @@
 #include <unistd.h>
 
 #define MAX_ALLOCATION_SIZE (1e8)
+#define ALIGNMENT (16)
+#define CHUNK_SIZE (1024 * 1024)
 
 TEST_CASE("Sanity", "[malloc1]")
 {
     void *base = sbrk(0);
     char *a = (char *)smalloc(10);
     REQUIRE(a != nullptr);
-    REQUIRE(base == a);
+    REQUIRE((size_t)a % ALIGNMENT == 0);
+    REQUIRE((size_t)a - (size_t)base < ALIGNMENT);
 }
 
 TEST_CASE("Check size", "[malloc1]")
@@ -18,15 +21,31 @@ TEST_CASE("Check size", "[malloc1]")
     void *base = sbrk(0);
     char *a = (char *)smalloc(1);
     REQUIRE(a != nullptr);
-    REQUIRE(base == a);
     void *after = sbrk(0);
-    REQUIRE(1 == (size_t)after - (size_t)base);
+    REQUIRE((size_t)after - (size_t)base >= CHUNK_SIZE);
+    REQUIRE((size_t)after - (size_t)base < CHUNK_SIZE + ALIGNMENT);
 
     char *b = (char *)smalloc(10);
     REQUIRE(b != nullptr);
-    REQUIRE((char *)base + 1 == b);
+    REQUIRE(a + ALIGNMENT == b);
+    REQUIRE(after == sbrk(0));
+}
+
+TEST_CASE("Chunk refill", "[malloc1]")
+{
+    void *base = sbrk(0);
+    char *a = (char *)smalloc(CHUNK_SIZE - ALIGNMENT);
+    REQUIRE(a != nullptr);
+    void *after = sbrk(0);
+
+    char *b = (char *)smalloc(ALIGNMENT);
+    REQUIRE(b == a + CHUNK_SIZE - ALIGNMENT);
+    REQUIRE(after == sbrk(0));
+
+    char *c = (char *)smalloc(1);
+    REQUIRE(c == b + ALIGNMENT);
     after = sbrk(0);
-    REQUIRE(11 == (size_t)after - (size_t)base);
+    REQUIRE((size_t)after - (size_t)base >= 3 * CHUNK_SIZE);
 }
 
 TEST_CASE("0 size", "[malloc1]")
@@ -44,10 +63,39 @@ TEST_CASE("Max size", "[malloc1]")
     char *a = (char *)smalloc(MAX_ALLOCATION_SIZE);
     REQUIRE(a != nullptr);
     void *after = sbrk(0);
-    REQUIRE(MAX_ALLOCATION_SIZE == (size_t)after - (size_t)base);
+    REQUIRE(MAX_ALLOCATION_SIZE <= (size_t)after - (size_t)base);
 
     char *b = (char *)smalloc(MAX_ALLOCATION_SIZE + 1);
     REQUIRE(b == nullptr);
-    after = sbrk(0);
-    REQUIRE(MAX_ALLOCATION_SIZE == (size_t)after - (size_t)base);
+    REQUIRE(after == sbrk(0));
+}
+
+TEST_CASE("Arena", "[malloc1]")
+{
+    void *base = sbrk(0);
+    Arena *arena = sarena_create(1024);
+    REQUIRE(arena != nullptr);
+
+    char *a = (char *)sarena_alloc(arena, 10);
+    REQUIRE(a != nullptr);
+    REQUIRE((size_t)a % ALIGNMENT == 0);
+    char *b = (char *)sarena_alloc(arena, 10);
+    REQUIRE(b == a + ALIGNMENT);
+    REQUIRE(sarena_alloc(arena, 0) == nullptr);
+
+    void *mark = sarena_mark(arena);
+    char *c = (char *)sarena_alloc(arena, 100);
+    REQUIRE(c == b + ALIGNMENT);
+    char *d = (char *)sarena_alloc(arena, 2 * CHUNK_SIZE);
+    REQUIRE(d != nullptr);
+    d[2 * CHUNK_SIZE - 1] = 'd';
+
+    sarena_rewind(arena, mark);
+    REQUIRE(sarena_alloc(arena, 100) == c);
+
+    sarena_reset(arena);
+    REQUIRE(sarena_alloc(arena, 10) == a);
+
+    sarena_destroy(arena);
+    REQUIRE(base == sbrk(0));
 }
@@ -450,6 +450,38 @@ TEST_CASE("Reuse two blocks sizes large", "[malloc2]")
     verify_size(base);
 }
 
+TEST_CASE("Wilderness", "[malloc2]")
+{
+    verify_blocks(0, 0, 0, 0);
+
+    void *base = sbrk(0);
+    char *a = (char *)smalloc(10);
+    REQUIRE(a != nullptr);
+    char *b = (char *)smalloc(10);
+    REQUIRE(b != nullptr);
+
+    verify_blocks(2, 20, 0, 0);
+    verify_size(base);
+
+    sfree(b);
+    verify_blocks(2, 20, 1, 10);
+    verify_size(base);
+
+    char *c = (char *)smalloc(100);
+    REQUIRE(c != nullptr);
+    REQUIRE(c == b);
+    void *after = sbrk(0);
+    REQUIRE(110 + _size_meta_data() * 2 == (size_t)after - (size_t)base);
+
+    verify_blocks(2, 110, 0, 0);
+    verify_size(base);
+
+    sfree(a);
+    sfree(c);
+    verify_blocks(2, 110, 2, 110);
+    verify_size(base);
+}
+
 TEST_CASE("scalloc", "[malloc2]")
 {
     verify_blocks(0, 0, 0, 0);
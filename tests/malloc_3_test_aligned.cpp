@@ -0,0 +1,66 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+#include <stdint.h>
+
+#define MMAP_THRESHOLD (128 * 1024)
+
+TEST_CASE("saligned_alloc natural alignment", "[malloc3]")
+{
+    for (size_t alignment = 32; alignment <= MMAP_THRESHOLD; alignment *= 2)
+    {
+        char *a = (char *)saligned_alloc(alignment, 100);
+        REQUIRE(a != nullptr);
+        REQUIRE((uintptr_t)a % alignment == 0);
+        memset(a, 'a', alignment > 100 ? alignment : 100);
+        sfree(a);
+    }
+    REQUIRE(_num_free_blocks() == 32);
+    REQUIRE(_num_allocated_blocks() == 32);
+}
+
+TEST_CASE("saligned_alloc no over-allocation", "[malloc3]")
+{
+    // a page aligned page is exactly one order 5 block: orders 5-9 stay free
+    char *a = (char *)saligned_alloc(4096, 4096);
+    REQUIRE(a != nullptr);
+    REQUIRE((uintptr_t)a % 4096 == 0);
+    memset(a, 'a', 4096);
+    REQUIRE(_num_free_blocks() == 31 + 5);
+    REQUIRE(_num_allocated_blocks() == 32 + 5);
+
+    char *b = (char *)smalloc(4096 - _size_meta_data());
+    REQUIRE(b != nullptr);
+    REQUIRE(b == a + 4096 + _size_meta_data());
+    for (size_t i = 0; i < 4096; i++)
+    {
+        REQUIRE(a[i] == 'a');
+    }
+
+    sfree(a);
+    sfree(b);
+    REQUIRE(_num_free_blocks() == 32);
+    REQUIRE(_num_allocated_blocks() == 32);
+}
+
+TEST_CASE("saligned_alloc large", "[malloc3]")
+{
+    char *a = (char *)saligned_alloc(2 * MMAP_THRESHOLD, 100);
+    REQUIRE(a != nullptr);
+    REQUIRE((uintptr_t)a % (2 * MMAP_THRESHOLD) == 0);
+    char *b = (char *)saligned_alloc(4096, MMAP_THRESHOLD + 1);
+    REQUIRE(b != nullptr);
+    REQUIRE((uintptr_t)b % 4096 == 0);
+    memset(b, 'b', MMAP_THRESHOLD + 1);
+    REQUIRE(_num_allocated_blocks() == 32 + 2);
+    sfree(a);
+    sfree(b);
+    REQUIRE(_num_allocated_blocks() == 32);
+}
+
+TEST_CASE("saligned_alloc bad alignment", "[malloc3]")
+{
+    REQUIRE(saligned_alloc(48, 100) == nullptr);
+    REQUIRE(saligned_alloc(64, 0) == nullptr);
+}
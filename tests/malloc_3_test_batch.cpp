@@ -0,0 +1,86 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#define MMAP_THRESHOLD (128 * 1024)
+#define NUM_ARENAS 32
+
+TEST_CASE("smalloc_batch splits one block", "[malloc3]")
+{
+    void *first = smalloc(10);
+    REQUIRE(first != nullptr);
+    sfree(first);
+    size_t free_blocks = _num_free_blocks();
+    size_t free_bytes = _num_free_bytes();
+    REQUIRE(free_blocks == NUM_ARENAS);
+
+    void *blocks[8];
+    REQUIRE(smalloc_batch(40, 8, blocks) == 8);
+    for (int i = 0; i < 8; i++)
+    {
+        REQUIRE((char *)blocks[i] == (char *)blocks[0] + i * 128);
+        memset(blocks[i], i, 40);
+    }
+    // the rest of the arena is left as one free block of each order 3..9
+    REQUIRE(_num_free_blocks() == NUM_ARENAS - 1 + 7);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS - 1 + 7 + 8);
+
+    std::swap(blocks[0], blocks[5]);
+    std::swap(blocks[2], blocks[7]);
+    void *passed[8];
+    std::copy(blocks, blocks + 8, passed);
+    sfree_batch(blocks, 8);
+    REQUIRE(std::equal(blocks, blocks + 8, passed));
+    REQUIRE(_num_free_blocks() == free_blocks);
+    REQUIRE(_num_free_bytes() == free_bytes);
+    REQUIRE(_num_allocated_blocks() == free_blocks);
+}
+
+TEST_CASE("smalloc_batch runs out", "[malloc3]")
+{
+    void *blocks[NUM_ARENAS + 8];
+    REQUIRE(smalloc_batch(MMAP_THRESHOLD - _size_meta_data(), NUM_ARENAS + 8, blocks) == NUM_ARENAS);
+    REQUIRE(_num_free_blocks() == 0);
+    REQUIRE(smalloc(40) == nullptr);
+    sfree_batch(blocks, NUM_ARENAS);
+    REQUIRE(_num_free_blocks() == NUM_ARENAS);
+    REQUIRE(_num_free_bytes() == NUM_ARENAS * (MMAP_THRESHOLD - _size_meta_data()));
+
+    void *big[3];
+    REQUIRE(smalloc_batch(MMAP_THRESHOLD + 100, 3, big) == 3);
+    REQUIRE(_num_allocated_bytes() == NUM_ARENAS * (MMAP_THRESHOLD - _size_meta_data()) + 3 * (MMAP_THRESHOLD + 100));
+    sfree_batch(big, 3);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+}
+
+TEST_CASE("sfree_batch mixed", "[malloc3]")
+{
+    void *ptrs[6];
+    ptrs[0] = smalloc(40);
+    ptrs[1] = smalloc(5000);
+    ptrs[2] = nullptr;
+    ptrs[3] = smalloc(MMAP_THRESHOLD + 100);
+    ptrs[4] = saligned_alloc(1024, 100);
+    ptrs[5] = smalloc(40);
+    sfree_batch(ptrs, 6);
+    REQUIRE(_num_free_blocks() == NUM_ARENAS);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+    REQUIRE(_num_free_bytes() == NUM_ARENAS * (MMAP_THRESHOLD - _size_meta_data()));
+}
+
+TEST_CASE("sfree_batch past one chunk", "[malloc3]")
+{
+    // more than sfree_batch sorts at once, buddies split between chunks
+    void *blocks[1000];
+    REQUIRE(smalloc_batch(40, 1000, blocks) == 1000);
+    std::reverse(blocks, blocks + 1000);
+    for (int i = 0; i < 1000; i += 3)
+    {
+        std::swap(blocks[i], blocks[999 - i]);
+    }
+    sfree_batch(blocks, 1000);
+    REQUIRE(_num_free_blocks() == NUM_ARENAS);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+}
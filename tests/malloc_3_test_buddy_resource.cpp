@@ -0,0 +1,144 @@
+#include "my_stdlib.h"
+#include "../buddy_resource.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define NUM_ARENAS 32
+
+static size_t usedBlocks()
+{
+    return _num_allocated_blocks() - _num_free_blocks();
+}
+
+TEST_CASE("pmr containers on the buddy heap", "[malloc3]")
+{
+    {
+        std::pmr::map<int, std::pmr::string> m(buddy_resource());
+        for (int i = 0; i < 1000; i++)
+        {
+            m.emplace(i, std::pmr::string(std::to_string(i) + " is past the small string buffer"));
+        }
+        REQUIRE(usedBlocks() >= 2000);
+        REQUIRE(m[999] == "999 is past the small string buffer");
+        for (int i = 0; i < 1000; i += 2)
+        {
+            m.erase(i);
+        }
+        REQUIRE(m.size() == 500);
+    }
+    REQUIRE(usedBlocks() == 0);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+
+    // resources compare equal, so a container can take over another's memory
+    BuddyResource other;
+    REQUIRE(other == *buddy_resource());
+}
+
+TEST_CASE("SAllocator passes the size back", "[malloc3]")
+{
+    {
+        std::vector<int, SAllocator<int>> v;
+        for (int i = 0; i < 10000; i++)
+        {
+            v.push_back(i);
+        }
+        REQUIRE(usedBlocks() == 1);
+        REQUIRE(v[9999] == 9999);
+        std::map<int, int, std::less<int>, SAllocator<std::pair<const int, int>>> m;
+        m[1] = 2;
+        REQUIRE(usedBlocks() == 2);
+    }
+    REQUIRE(usedBlocks() == 0);
+
+    // deallocate goes through sfree_sized with the size the block was asked for
+    SAllocator<char> a;
+    char *p = a.allocate(300);
+    REQUIRE(susable_size(p) == 512 - _size_meta_data());
+    a.deallocate(p, 300);
+    REQUIRE(usedBlocks() == 0);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+}
+
+struct alignas(256) Wide
+{
+    char bytes[300];
+};
+
+TEST_CASE("over-aligned buddy allocations", "[malloc3]")
+{
+    std::pmr::memory_resource *r = buddy_resource();
+    void *p = r->allocate(1000, 1024);
+    void *q = r->allocate(5000, 4096);
+    REQUIRE((uintptr_t)p % 1024 == 0);
+    REQUIRE((uintptr_t)q % 4096 == 0);
+    REQUIRE(usedBlocks() == 2);
+    r->deallocate(p, 1000, 1024);
+    r->deallocate(q, 5000, 4096);
+    REQUIRE(usedBlocks() == 0);
+
+    {
+        std::vector<Wide, SAllocator<Wide>> v(10);
+        REQUIRE((uintptr_t)v.data() % 256 == 0);
+    }
+    REQUIRE(usedBlocks() == 0);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+}
+
+TEST_CASE("buddy containers past the 32 arenas", "[malloc3]")
+{
+    {
+        // 128 byte nodes, more than the 32768 the first 32 arenas hold
+        std::pmr::map<int, int> m(buddy_resource());
+        for (int i = 0; i < 50000; i++)
+        {
+            m[i] = i;
+        }
+        REQUIRE(m.size() == 50000);
+        REQUIRE(usedBlocks() == 50000);
+    }
+    REQUIRE(usedBlocks() == 0);
+    REQUIRE(_num_allocated_blocks() > NUM_ARENAS);
+}
+
+TEST_CASE("buddy containers in several threads", "[malloc3]")
+{
+    std::vector<std::thread> threads;
+    threads.reserve(8);
+    size_t sums[8] = {};
+    for (int t = 0; t < 8; t++)
+    {
+        threads.emplace_back([&sums, t]() {
+            std::pmr::map<int, std::pmr::string> m(buddy_resource());
+            std::vector<int, SAllocator<int>> v;
+            for (int i = 0; i < 5000; i++)
+            {
+                m.emplace(i, std::pmr::string(100 + i % 200, (char)('a' + t)));
+                v.push_back(i);
+                if (i % 2)
+                {
+                    m.erase(i / 2);
+                }
+            }
+            for (auto &entry : m)
+            {
+                sums[t] += entry.second.size() + (entry.second[0] == 'a' + t);
+            }
+            sums[t] += v.size();
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    for (int t = 1; t < 8; t++)
+    {
+        REQUIRE(sums[t] == sums[0]);
+    }
+    REQUIRE(usedBlocks() == 0);
+}
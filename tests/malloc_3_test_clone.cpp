@@ -0,0 +1,95 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+#include <dirent.h>
+
+#define MMAP_THRESHOLD (128 * 1024)
+#define NUM_ARENAS 32
+
+static int openFds()
+{
+    int count = 0;
+    DIR *dir = opendir("/proc/self/fd");
+    while (readdir(dir))
+    {
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+static bool filled(const char *p, size_t size, char c)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (p[i] != c)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE("sclone of small blocks", "[malloc3]")
+{
+    REQUIRE(sclone(nullptr) == nullptr);
+    char *a = (char *)smalloc(100);
+    memset(a, 'a', 100);
+    char *b = (char *)sclone(a);
+    REQUIRE(b != nullptr);
+    REQUIRE(b != a);
+    REQUIRE(filled(b, 100, 'a'));
+    REQUIRE(susable_size(b) == susable_size(a));
+
+    char *c = (char *)saligned_alloc(4096, 4096);
+    memset(c, 'c', 4096);
+    char *d = (char *)sclone(c);
+    REQUIRE((size_t)d % 4096 == 0);
+    REQUIRE(filled(d, 4096, 'c'));
+    sfree(a);
+    sfree(b);
+    sfree(c);
+    sfree(d);
+    REQUIRE(_num_free_blocks() == NUM_ARENAS);
+}
+
+TEST_CASE("sclone of big blocks is copy on write", "[malloc3]")
+{
+    int fds = openFds();
+    const size_t size = 8 * 1024 * 1024;
+    char *original = (char *)smalloc(size);
+    REQUIRE(original != nullptr);
+    memset(original, 'o', size);
+
+    char *clone = (char *)sclone(original);
+    REQUIRE(clone != nullptr);
+    REQUIRE(filled(clone, size, 'o'));
+    REQUIRE(_num_allocated_bytes() == NUM_ARENAS * (MMAP_THRESHOLD - _size_meta_data()) + 2 * size);
+
+    // writes on either side stay on that side
+    memset(original, 'x', 4096 * 3);
+    original[size - 1] = 'y';
+    REQUIRE(filled(clone, size, 'o'));
+    clone[100] = 'c';
+    REQUIRE(original[100] == 'x');
+
+    // a clone of a written block has the writes
+    char *again = (char *)sclone(original);
+    REQUIRE(filled(again, 4096 * 3, 'x'));
+    REQUIRE(filled(again + 4096 * 3, size - 4096 * 3 - 1, 'o'));
+    REQUIRE(again[size - 1] == 'y');
+
+    // and so does a clone of a clone
+    char *nested = (char *)sclone(clone);
+    REQUIRE(nested[100] == 'c');
+    REQUIRE(filled(nested + 101, size - 101, 'o'));
+
+    sfree(original);
+    REQUIRE(filled(again, 4096 * 3, 'x'));
+    sfree(clone);
+    sfree(again);
+    sfree(nested);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+    REQUIRE(openFds() == fds);
+}
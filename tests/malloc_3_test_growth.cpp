@@ -0,0 +1,46 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+
+#define MMAP_THRESHOLD (128 * 1024)
+#define NUM_ARENAS 32
+
+TEST_CASE("heap grows in place", "[malloc3]")
+{
+    REQUIRE_FALSE(smalloc_set_max_arenas(NUM_ARENAS - 1));
+    REQUIRE_FALSE(smalloc_set_max_arenas(1 << 20));
+    REQUIRE(smalloc_set_max_arenas(2 * NUM_ARENAS));
+
+    const size_t whole = MMAP_THRESHOLD - _size_meta_data();
+    char *arenas[2 * NUM_ARENAS];
+    for (int i = 0; i < 2 * NUM_ARENAS; i++)
+    {
+        arenas[i] = (char *)smalloc(whole);
+        REQUIRE(arenas[i] != nullptr);
+        REQUIRE(arenas[i] == arenas[0] + (size_t)i * MMAP_THRESHOLD);
+        memset(arenas[i], i, whole);
+    }
+    REQUIRE(_num_allocated_blocks() == 2 * NUM_ARENAS);
+    REQUIRE(_num_free_blocks() == 0);
+    REQUIRE(smalloc(40) == nullptr);
+    REQUIRE_FALSE(smalloc_set_max_arenas(NUM_ARENAS));
+
+    for (int i = 0; i < 2 * NUM_ARENAS; i++)
+    {
+        sfree(arenas[i]);
+    }
+    REQUIRE(_num_free_blocks() == 2 * NUM_ARENAS);
+    REQUIRE(_num_free_bytes() == 2 * NUM_ARENAS * whole);
+
+    // a batch grows it too
+    REQUIRE(smalloc_set_max_arenas(2 * NUM_ARENAS + 2));
+    void *blocks[2 * NUM_ARENAS + 3];
+    REQUIRE(smalloc_batch(whole, 2 * NUM_ARENAS + 3, blocks) == 2 * NUM_ARENAS + 2);
+    sfree_batch(blocks, 2 * NUM_ARENAS + 2);
+    REQUIRE(_num_free_blocks() == 2 * NUM_ARENAS + 2);
+
+    // small blocks split the new arenas like the first ones
+    REQUIRE(smalloc(40) != nullptr);
+    REQUIRE(_num_free_blocks() == 2 * NUM_ARENAS + 2 - 1 + 10);
+}
@@ -0,0 +1,62 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+#include <cstring>
+
+#define MMAP_THRESHOLD (128 * 1024)
+#define NUM_ARENAS 32
+
+TEST_CASE("sheap is independent", "[malloc3]")
+{
+    REQUIRE(sheap_create(0) == nullptr);
+    REQUIRE(sheap_create(NUM_ARENAS * MMAP_THRESHOLD + 1) == nullptr);
+
+    SHeap *a = sheap_create(MMAP_THRESHOLD);
+    SHeap *b = sheap_create(2 * MMAP_THRESHOLD);
+    REQUIRE(a != nullptr);
+    REQUIRE(b != nullptr);
+
+    // a holds exactly one arena
+    char *whole = (char *)sheap_alloc(a, MMAP_THRESHOLD - _size_meta_data());
+    REQUIRE(whole != nullptr);
+    REQUIRE(((uintptr_t)whole - _size_meta_data()) % MMAP_THRESHOLD == 0);
+    memset(whole, 'a', MMAP_THRESHOLD - _size_meta_data());
+    REQUIRE(sheap_alloc(a, 40) == nullptr);
+
+    char *small = (char *)sheap_alloc(b, 40);
+    REQUIRE(small != nullptr);
+    REQUIRE(sheap_alloc(b, MMAP_THRESHOLD - _size_meta_data()) != nullptr);
+    REQUIRE(sheap_alloc(b, MMAP_THRESHOLD - _size_meta_data()) == nullptr);
+
+    sheap_free(a, whole);
+    REQUIRE(sheap_alloc(a, 40) != nullptr);
+
+    // none of it shows up in the global heap
+    void *global = smalloc(40);
+    REQUIRE(global != nullptr);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS + 10);
+    sfree(global);
+
+    sheap_destroy(a);
+    sheap_destroy(b);
+    sheap_destroy(nullptr);
+}
+
+TEST_CASE("sheap_destroy releases everything", "[malloc3]")
+{
+    for (int i = 0; i < 64; i++)
+    {
+        SHeap *heap = sheap_create(NUM_ARENAS * MMAP_THRESHOLD);
+        REQUIRE(heap != nullptr);
+        for (int j = 0; j < 100; j++)
+        {
+            char *p = (char *)sheap_alloc(heap, 100 * j + 1);
+            REQUIRE(p != nullptr);
+            p[100 * j] = 'x';
+        }
+        // mmap'd blocks are unmapped with the heap
+        REQUIRE(sheap_alloc(heap, 10 * MMAP_THRESHOLD) != nullptr);
+        sheap_destroy(heap);
+    }
+}
@@ -0,0 +1,226 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+
+#define MMAP_THRESHOLD (128 * 1024)
+#define NUM_ARENAS 32
+
+static bool filled(const char *p, size_t size, char c)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (p[i] != c)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#define HEAP_BYTES (NUM_ARENAS * (MMAP_THRESHOLD - _size_meta_data()))
+
+TEST_CASE("srealloc of mmap'd blocks", "[malloc3]")
+{
+    size_t size = MMAP_THRESHOLD + 100;
+    char *p = (char *)smalloc(size);
+    REQUIRE(p != nullptr);
+    memset(p, 'a', size);
+
+    // growing keeps the contents and the block count
+    for (size_t next = 1 << 20; next <= 64 << 20; next *= 4)
+    {
+        p = (char *)srealloc(p, next);
+        REQUIRE(p != nullptr);
+        REQUIRE(filled(p, MMAP_THRESHOLD + 100, 'a'));
+        REQUIRE(filled(p + MMAP_THRESHOLD + 100, size - MMAP_THRESHOLD - 100, 'b'));
+        REQUIRE(_num_allocated_blocks() == NUM_ARENAS + 1);
+        REQUIRE(_num_allocated_bytes() == HEAP_BYTES + next);
+        memset(p + size, 'b', next - size);
+        size = next;
+    }
+
+    // shrinking unmaps the tail
+    p = (char *)srealloc(p, 200 * 1024);
+    REQUIRE(filled(p, MMAP_THRESHOLD + 100, 'a'));
+    REQUIRE(filled(p + MMAP_THRESHOLD + 100, 200 * 1024 - MMAP_THRESHOLD - 100, 'b'));
+    REQUIRE(_num_allocated_bytes() == HEAP_BYTES + 200 * 1024);
+    REQUIRE(srealloc(p, 100000001) == nullptr);
+    REQUIRE(_num_allocated_bytes() == HEAP_BYTES + 200 * 1024);
+
+    // below the threshold it becomes a buddy block
+    p = (char *)srealloc(p, 1000);
+    REQUIRE(filled(p, 1000, 'a'));
+    REQUIRE(susable_size(p) == 2048 - _size_meta_data());
+    REQUIRE(_num_free_blocks() == NUM_ARENAS - 1 + 6);
+    sfree(p);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+    REQUIRE(_num_allocated_bytes() == HEAP_BYTES);
+}
+
+TEST_CASE("srealloc of several mmap'd blocks", "[malloc3]")
+{
+    char *blocks[4];
+    for (int i = 0; i < 4; i++)
+    {
+        blocks[i] = (char *)smalloc(MMAP_THRESHOLD * (i + 1));
+        memset(blocks[i], 'a' + i, MMAP_THRESHOLD * (i + 1));
+    }
+    // the middle ones have to move
+    blocks[1] = (char *)srealloc(blocks[1], 16 << 20);
+    blocks[2] = (char *)srealloc(blocks[2], 16 << 20);
+    REQUIRE(filled(blocks[1], 2 * MMAP_THRESHOLD, 'b'));
+    REQUIRE(filled(blocks[2], 3 * MMAP_THRESHOLD, 'c'));
+
+    // and a cloned block grows its file with it
+    char *clone = (char *)sclone(blocks[0]);
+    clone = (char *)srealloc(clone, 8 << 20);
+    REQUIRE(filled(clone, MMAP_THRESHOLD, 'a'));
+    memset(clone, 'z', 8 << 20);
+    REQUIRE(filled(blocks[0], MMAP_THRESHOLD, 'a'));
+
+    for (int i = 0; i < 4; i++)
+    {
+        sfree(blocks[i]);
+    }
+    sfree(clone);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+    REQUIRE(_num_allocated_bytes() == HEAP_BYTES);
+}
+
+TEST_CASE("srealloc leaves headroom for growing blocks", "[malloc3]")
+{
+    size_t size = 100;
+    char *p = (char *)smalloc(size);
+    memset(p, 'a', size);
+    int resizes = 0;
+    size_t capacity = susable_size(p);
+    while (size < 50 * 1024 * 1024)
+    {
+        size_t next = size + size / 8 + 1000;
+        p = (char *)srealloc(p, next);
+        REQUIRE(p != nullptr);
+        memset(p + size, 'a', next - size);
+        size = next;
+        if (susable_size(p) != capacity)
+        {
+            resizes++;
+            capacity = susable_size(p);
+        }
+        REQUIRE(capacity >= size);
+    }
+    // a few buddy sizes, then doubling mmap capacity
+    REQUIRE(resizes < 20);
+    REQUIRE(filled(p, size, 'a'));
+    REQUIRE(_num_allocated_bytes() == HEAP_BYTES + capacity);
+
+    // small shrinks keep the headroom, big ones give it back
+    REQUIRE(srealloc(p, capacity - 1000) == p);
+    REQUIRE(susable_size(p) == capacity);
+    p = (char *)srealloc(p, 1024 * 1024);
+    REQUIRE(susable_size(p) == 1024 * 1024);
+    REQUIRE(filled(p, 1024 * 1024, 'a'));
+    sfree(p);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+    REQUIRE(_num_allocated_bytes() == HEAP_BYTES);
+}
+
+TEST_CASE("srealloc keeps small growing blocks on the buddy heap", "[malloc3]")
+{
+    char *blocks[100];
+    for (int i = 0; i < 100; i++)
+    {
+        blocks[i] = (char *)smalloc(16);
+        memset(blocks[i], 'a', 16);
+    }
+    for (size_t size = 32; size <= 4096; size *= 2)
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            blocks[i] = (char *)srealloc(blocks[i], size);
+            REQUIRE(blocks[i] != nullptr);
+            memset(blocks[i] + size / 2, 'a', size / 2);
+        }
+    }
+    for (int i = 0; i < 100; i++)
+    {
+        REQUIRE(susable_size(blocks[i]) == 8192 - _size_meta_data());
+        REQUIRE(filled(blocks[i], 4096, 'a'));
+    }
+    for (int i = 0; i < 100; i++)
+    {
+        sfree(blocks[i]);
+    }
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+    REQUIRE(_num_allocated_bytes() == HEAP_BYTES);
+}
+
+TEST_CASE("srealloc shrinks headroom blocks back to the buddy heap", "[malloc3]")
+{
+    size_t size = 1000;
+    char *p = (char *)smalloc(size);
+    memset(p, 'a', size);
+    while (size < 4 * MMAP_THRESHOLD)
+    {
+        size *= 2;
+        p = (char *)srealloc(p, size);
+        memset(p + size / 2, 'a', size / 2);
+    }
+    REQUIRE(susable_size(p) > size);
+    p = (char *)srealloc(p, 100);
+    REQUIRE(susable_size(p) == 256 - _size_meta_data());
+    REQUIRE(filled(p, 100, 'a'));
+    sfree(p);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+    REQUIRE(_num_allocated_bytes() == HEAP_BYTES);
+}
+
+TEST_CASE("sexpand grows in place or not at all", "[malloc3]")
+{
+    char *a = (char *)smalloc(100); // order 1, the rest of the arena is split off after it
+    memset(a, 'a', 100);
+    REQUIRE(sexpand(a, 200));
+    REQUIRE(susable_size(a) == 256 - _size_meta_data());
+    // takes the free upper buddies at every order on the way
+    REQUIRE(sexpand(a, 60000));
+    REQUIRE(susable_size(a) == 64 * 1024 - _size_meta_data());
+    REQUIRE(filled(a, 100, 'a'));
+    REQUIRE(_num_free_blocks() == NUM_ARENAS);
+
+    // a used upper buddy blocks it
+    char *b = (char *)smalloc(100);
+    REQUIRE(b == a + 64 * 1024);
+    REQUIRE(!sexpand(a, 100000));
+    REQUIRE(susable_size(a) == 64 * 1024 - _size_meta_data());
+    // and an upper half can't grow into its lower buddy
+    sfree(a);
+    REQUIRE(!sexpand(b, 100000));
+    REQUIRE(!sexpand(b, 1e8 + 1));
+
+    // srealloc uses the same path before it moves
+    REQUIRE(srealloc(b, 60000) == b);
+    REQUIRE(srealloc(b, 100000) != b);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+    REQUIRE(_num_allocated_bytes() == HEAP_BYTES);
+}
+
+TEST_CASE("srealloc shrinks buddy blocks in place", "[malloc3]")
+{
+    char *p = (char *)smalloc(60000);
+    memset(p, 'a', 60000);
+    REQUIRE(_num_free_blocks() == NUM_ARENAS);
+    p = (char *)srealloc(p, 200);
+    REQUIRE(susable_size(p) == 256 - _size_meta_data());
+    REQUIRE(filled(p, 200, 'a'));
+    // the 64KB block's halves from 32KB down to 256 bytes are free again
+    REQUIRE(_num_free_blocks() == NUM_ARENAS + 8);
+    REQUIRE(_num_allocated_bytes() == HEAP_BYTES - 9 * _size_meta_data());
+
+    // the freed halves are reused
+    char *q = (char *)smalloc(200);
+    REQUIRE(q == p + 256);
+    sfree(q);
+    sfree(p);
+    REQUIRE(_num_free_blocks() == NUM_ARENAS);
+    REQUIRE(_num_allocated_bytes() == HEAP_BYTES);
+}
@@ -0,0 +1,142 @@
+// built with malloc_3_new.cpp, so Catch's own allocations use the buddy heap too
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+static size_t usedBlocks()
+{
+    return _num_allocated_blocks() - _num_free_blocks();
+}
+
+struct alignas(256) Wide
+{
+    char bytes[300];
+};
+
+TEST_CASE("sized new and delete", "[malloc3]")
+{
+    size_t before = usedBlocks();
+    int *one = new int(7);
+    int *many = new int[1000];
+    size_t during = usedBlocks();
+    ::operator delete(one, sizeof(int));
+    delete[] many;
+    size_t after = usedBlocks();
+    REQUIRE(during == before + 2);
+    REQUIRE(after == before);
+
+    // the size goes through sfree_sized
+    void *p = ::operator new(100);
+    size_t size = susable_size(p);
+    ::operator delete(p, 100);
+    REQUIRE(size == 128 * 2 - _size_meta_data());
+    REQUIRE(usedBlocks() == before);
+}
+
+TEST_CASE("aligned new and delete", "[malloc3]")
+{
+    size_t before = usedBlocks();
+    Wide *w = new Wide;
+    Wide *ws = new Wide[4];
+    void *raw = ::operator new(5000, std::align_val_t(4096));
+    bool aligned = (uintptr_t)w % 256 == 0 && (uintptr_t)ws % 256 == 0 && (uintptr_t)raw % 4096 == 0;
+    delete w;
+    delete[] ws;
+    ::operator delete(raw, 5000, std::align_val_t(4096));
+    size_t after = usedBlocks();
+    REQUIRE(aligned);
+    REQUIRE(after == before);
+}
+
+TEST_CASE("nothrow new", "[malloc3]")
+{
+    size_t before = usedBlocks();
+    int *p = new (std::nothrow) int[10];
+    bool got = p != nullptr;
+    delete[] p;
+    size_t after = usedBlocks();
+    REQUIRE(got);
+    REQUIRE(after == before);
+    REQUIRE(::operator new((size_t)-1 / 2, std::nothrow) == nullptr);
+    REQUIRE_THROWS_AS(::operator new((size_t)-1 / 2), std::bad_alloc);
+}
+
+TEST_CASE("new past the 1e8 limit", "[malloc3]")
+{
+    // served from mmap, like the preload shim does
+    size_t before = usedBlocks();
+    char *huge = new char[(size_t)200000000];
+    void *aligned_huge = ::operator new(200000000, std::align_val_t(4096), std::nothrow);
+    huge[0] = 1;
+    huge[199999999] = 2;
+    bool aligned = aligned_huge && (uintptr_t)aligned_huge % 4096 == 0;
+    size_t during = usedBlocks();
+    delete[] huge;
+    ::operator delete(aligned_huge, std::align_val_t(4096));
+    REQUIRE(aligned);
+    REQUIRE(during == before + 2);
+    REQUIRE(usedBlocks() == before);
+}
+
+TEST_CASE("containers past the 32 arenas", "[malloc3]")
+{
+    // unordered free lists keep the inserts from walking the lists
+    std::map<int, std::string> m;
+    for (int i = 0; i < 200000; i++)
+    {
+        m[i] = std::to_string(i) + " is some value long enough to skip SSO";
+    }
+    REQUIRE(m.size() == 200000);
+    REQUIRE(m[199999].substr(0, 6) == "199999");
+}
+
+TEST_CASE("new and delete from several threads", "[malloc3]")
+{
+    size_t before = usedBlocks();
+    std::atomic<int> bad(0);
+    std::vector<std::thread> threads;
+    threads.reserve(8);
+    for (int t = 0; t < 8; t++)
+    {
+        threads.emplace_back([&bad, t]() {
+            std::vector<std::string *> live;
+            for (int i = 0; i < 20000; i++)
+            {
+                live.push_back(new std::string(100 + i % 900, (char)('a' + t)));
+                if (i % 3 == 0)
+                {
+                    std::string *s = live[live.size() / 2];
+                    live[live.size() / 2] = live.back();
+                    live.pop_back();
+                    if ((*s)[0] != 'a' + t)
+                    {
+                        bad++;
+                    }
+                    delete s;
+                }
+            }
+            for (std::string *s : live)
+            {
+                if ((*s)[s->size() - 1] != 'a' + t)
+                {
+                    bad++;
+                }
+                delete s;
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    size_t after = usedBlocks();
+    REQUIRE(bad == 0);
+    REQUIRE(after == before + 1); // the vector of threads
+}
@@ -0,0 +1,198 @@
+#include "my_stdlib.h"
+#include "../object_pool.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#define NUM_ARENAS 32
+
+struct Session
+{
+    static int constructed;
+    static int destructed;
+    int fd;
+    char buffer[20];
+    explicit Session(int fd) : fd(fd) { constructed++; }
+    ~Session() { destructed++; }
+};
+
+int Session::constructed = 0;
+int Session::destructed = 0;
+
+TEST_CASE("ObjectPool packs slots", "[malloc3]")
+{
+    {
+        ObjectPool<Session> pool;
+        REQUIRE(pool.slotSize() == 24);
+
+        Session *first = pool.create(1);
+        REQUIRE(first != nullptr);
+        REQUIRE(first->fd == 1);
+        // the slab and this thread's magazine
+        size_t used_blocks = _num_allocated_blocks() - _num_free_blocks();
+        REQUIRE(used_blocks == 2);
+
+        Session *prev = first;
+        for (size_t i = 1; i < pool.slotsPerSlab(); i++)
+        {
+            Session *s = pool.create((int)i);
+            REQUIRE((char *)s == (char *)prev + pool.slotSize());
+            prev = s;
+        }
+        REQUIRE(_num_allocated_blocks() - _num_free_blocks() == 2);
+
+        // the next slab is another buddy block
+        Session *next = pool.create(-1);
+        REQUIRE(next != nullptr);
+        REQUIRE(_num_allocated_blocks() - _num_free_blocks() == 3);
+
+        pool.destroy(first);
+        REQUIRE(Session::destructed == 1);
+        REQUIRE(pool.create(2) == first);
+        REQUIRE(first->fd == 2);
+    }
+    REQUIRE(_num_free_blocks() == NUM_ARENAS);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+}
+
+TEST_CASE("ObjectPool cached construction", "[malloc3]")
+{
+    Session::constructed = 0;
+    Session::destructed = 0;
+    {
+        ObjectPool<Session, true> pool;
+        Session *a = pool.create(1);
+        Session *b = pool.create(2);
+        pool.destroy(a);
+        pool.destroy(b);
+        REQUIRE(Session::destructed == 0);
+
+        Session *c = pool.create(3);
+        REQUIRE(c == b);
+        REQUIRE(c->fd == 2);
+        REQUIRE(Session::constructed == 2);
+
+        pool.trim();
+        REQUIRE(Session::destructed == 1);
+        Session *d = pool.create(4);
+        REQUIRE(d == a);
+        REQUIRE(d->fd == 4);
+        REQUIRE(Session::constructed == 3);
+        pool.destroy(c);
+        pool.destroy(d);
+    }
+    REQUIRE(Session::destructed == 3);
+    REQUIRE(_num_free_blocks() == NUM_ARENAS);
+}
+
+struct Packet
+{
+    int owner;
+    char data[28];
+    explicit Packet(int owner) : owner(owner) {}
+};
+
+TEST_CASE("ObjectPool per-thread pools", "[malloc3]")
+{
+    std::vector<std::thread> threads;
+    bool intact[4];
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([t, &intact] {
+            intact[t] = true;
+            std::vector<Packet *> live;
+            for (int round = 0; round < 50; round++)
+            {
+                // a few slabs each round, all of them back to the heap at the end
+                ObjectPool<Packet> pool;
+                for (int i = 0; i < 1000; i++)
+                {
+                    live.push_back(pool.create(t));
+                }
+                for (Packet *p : live)
+                {
+                    intact[t] = intact[t] && p->owner == t;
+                    pool.destroy(p);
+                }
+                live.clear();
+            }
+        });
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    for (int t = 0; t < 4; t++)
+    {
+        REQUIRE(intact[t]);
+    }
+    REQUIRE(_num_free_blocks() == NUM_ARENAS);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+}
+
+TEST_CASE("ObjectPool shared between threads", "[malloc3]")
+{
+    const int THREADS = 4;
+    const int OBJECTS = 20000;
+    {
+        ObjectPool<Packet> pool;
+        ObjectPool<Session, true> sessions;
+        std::vector<Packet *> made[THREADS];
+        std::atomic<int> bad(0);
+        size_t used[3];
+        for (int round = 0; round < 3; round++)
+        {
+            std::vector<std::thread> threads;
+            std::atomic<int> destroyed(0);
+            for (int t = 0; t < THREADS; t++)
+            {
+                threads.emplace_back([&, t] {
+                    // the previous round's objects come from another thread
+                    for (Packet *p : made[t])
+                    {
+                        bad += p->owner != (t + 1) % THREADS;
+                        pool.destroy(p);
+                    }
+                    made[t].clear();
+                    // everyone's frees are in before anyone allocates again
+                    destroyed++;
+                    while (destroyed < THREADS)
+                    {
+                        std::this_thread::yield();
+                    }
+                    for (int i = 0; i < OBJECTS; i++)
+                    {
+                        made[t].push_back(pool.create(t));
+                        Session *s = sessions.create(t);
+                        sessions.destroy(s);
+                    }
+                });
+            }
+            for (std::thread &thread : threads)
+            {
+                thread.join();
+            }
+            std::vector<Packet *> first = made[0];
+            for (int t = 0; t < THREADS - 1; t++)
+            {
+                made[t] = made[t + 1];
+            }
+            made[THREADS - 1] = first;
+            used[round] = _num_allocated_blocks() - _num_free_blocks();
+        }
+        REQUIRE(bad == 0);
+        // the slots freed by other threads are reused, the pools stop growing
+        REQUIRE(used[2] == used[1]);
+        for (std::vector<Packet *> &packets : made)
+        {
+            for (Packet *p : packets)
+            {
+                pool.destroy(p);
+            }
+        }
+    }
+    REQUIRE(_num_free_blocks() == NUM_ARENAS);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+}
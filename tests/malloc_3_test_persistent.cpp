@@ -0,0 +1,162 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MMAP_THRESHOLD (128 * 1024)
+
+struct Node
+{
+    size_t next; // offset of the next node
+    int value;
+    char name[100];
+};
+
+static std::string tempPath()
+{
+    char path[] = "/tmp/pheap_testXXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd != -1);
+    close(fd);
+    unlink(path);
+    return path;
+}
+
+TEST_CASE("pheap survives reopening", "[malloc3]")
+{
+    std::string path = tempPath();
+    PHeap *heap = pheap_open(path.c_str(), 4 * MMAP_THRESHOLD);
+    REQUIRE(heap != nullptr);
+    REQUIRE(pheap_root(heap) == nullptr);
+
+    size_t head = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        Node *node = (Node *)pheap_alloc(heap, sizeof(Node));
+        REQUIRE(node != nullptr);
+        node->next = head;
+        node->value = i;
+        snprintf(node->name, sizeof(node->name), "node %d", i);
+        head = pheap_offset(heap, node);
+    }
+    pheap_set_root(heap, pheap_at(heap, head));
+    // a heap that is still open can't be opened again
+    REQUIRE(pheap_open(path.c_str(), 0) == nullptr);
+    pheap_close(heap);
+
+    heap = pheap_open(path.c_str(), 0);
+    REQUIRE(heap != nullptr);
+    int expected = 999;
+    Node *node = (Node *)pheap_root(heap);
+    while (node)
+    {
+        char name[100];
+        snprintf(name, sizeof(name), "node %d", expected);
+        REQUIRE(node->value == expected);
+        REQUIRE(strcmp(node->name, name) == 0);
+        Node *next = (Node *)pheap_at(heap, node->next);
+        pheap_free(heap, node);
+        node = next;
+        expected--;
+    }
+    REQUIRE(expected == -1);
+    pheap_set_root(heap, nullptr);
+
+    // everything merged back into whole arenas
+    void *arenas[5];
+    for (int i = 0; i < 4; i++)
+    {
+        arenas[i] = pheap_alloc(heap, MMAP_THRESHOLD - 32);
+        REQUIRE(arenas[i] != nullptr);
+    }
+    REQUIRE(pheap_alloc(heap, 1) == nullptr);
+    REQUIRE(pheap_alloc(heap, MMAP_THRESHOLD) == nullptr);
+    pheap_close(heap);
+    unlink(path.c_str());
+}
+
+TEST_CASE("pheap_open rejects bad files", "[malloc3]")
+{
+    std::string path = tempPath();
+    // no file is left behind when no heap could be made
+    REQUIRE(pheap_open(path.c_str(), 0) == nullptr);
+    REQUIRE(access(path.c_str(), F_OK) != 0);
+    REQUIRE(pheap_open(path.c_str(), (size_t)1 << 62) == nullptr);
+    REQUIRE(access(path.c_str(), F_OK) != 0);
+    FILE *f = fopen(path.c_str(), "w");
+    REQUIRE(f != nullptr);
+    fputs("not a heap", f);
+    fclose(f);
+    REQUIRE(pheap_open(path.c_str(), MMAP_THRESHOLD) == nullptr);
+    unlink(path.c_str());
+    REQUIRE(pheap_open("/nonexistent/dir/heap", MMAP_THRESHOLD) == nullptr);
+}
+
+TEST_CASE("pheap_recover after a crash", "[malloc3]")
+{
+    std::string path = tempPath();
+    pid_t pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0)
+    {
+        // builds a list, frees every other node and dies without pheap_close
+        PHeap *heap = pheap_open(path.c_str(), 4 * MMAP_THRESHOLD);
+        size_t head = 0;
+        Node *nodes[1000];
+        for (int i = 0; i < 1000; i++)
+        {
+            nodes[i] = (Node *)pheap_alloc(heap, sizeof(Node));
+            nodes[i]->value = i;
+        }
+        for (int i = 0; i < 1000; i++)
+        {
+            if (i % 2)
+            {
+                pheap_free(heap, nodes[i]);
+                continue;
+            }
+            nodes[i]->next = head;
+            head = pheap_offset(heap, nodes[i]);
+        }
+        pheap_set_root(heap, nodes[998]);
+        _exit(0);
+    }
+    int status;
+    REQUIRE(waitpid(pid, &status, 0) == pid);
+    REQUIRE(pheap_open(path.c_str(), 0) == nullptr);
+
+    PHeap *heap = pheap_recover(path.c_str());
+    REQUIRE(heap != nullptr);
+    int expected = 998;
+    Node *node = (Node *)pheap_root(heap);
+    while (node)
+    {
+        REQUIRE(node->value == expected);
+        // the freed slots are reused, the live nodes are not handed out again
+        Node *fresh = (Node *)pheap_alloc(heap, sizeof(Node));
+        REQUIRE(fresh != nullptr);
+        fresh->value = -1;
+        REQUIRE(node->value == expected);
+        pheap_free(heap, fresh);
+        Node *next = (Node *)pheap_at(heap, node->next);
+        pheap_free(heap, node);
+        node = next;
+        expected -= 2;
+    }
+    REQUIRE(expected == -2);
+
+    // the rebuilt lists merge back into whole arenas
+    for (int i = 0; i < 4; i++)
+    {
+        REQUIRE(pheap_alloc(heap, MMAP_THRESHOLD - 32) != nullptr);
+    }
+    REQUIRE(pheap_alloc(heap, 1) == nullptr);
+    pheap_close(heap);
+    REQUIRE(pheap_recover("/nonexistent/dir/heap") == nullptr);
+    unlink(path.c_str());
+}
@@ -0,0 +1,97 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdlib>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// the shim is built on its own:
+//   g++ -O2 -shared -fPIC malloc_3_preload.cpp -o libmalloc_3.so -pthread
+// and found through MALLOC_3_PRELOAD, or in the working directory
+#ifndef MALLOC_3_PRELOAD_LIB
+#define MALLOC_3_PRELOAD_LIB "./libmalloc_3.so"
+#endif
+
+// absolute, since programs like pyenv's shims change directory before they exec
+static std::string preloadLib()
+{
+    const char *lib = getenv("MALLOC_3_PRELOAD");
+    char *path = realpath(lib ? lib : MALLOC_3_PRELOAD_LIB, nullptr);
+    std::string ret = path ? path : "";
+    free(path);
+    return ret;
+}
+
+// runs command through sh with the shim preloaded (sh included), returns
+// its stdout and requires a zero exit status
+static std::string runPreloaded(const std::string &command)
+{
+    std::string lib = preloadLib();
+    REQUIRE(!lib.empty());
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    pid_t pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0)
+    {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        setenv("LD_PRELOAD", lib.c_str(), 1);
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char *)nullptr);
+        _exit(127);
+    }
+    close(fds[1]);
+    std::string out;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0)
+    {
+        out.append(buf, n);
+    }
+    close(fds[0]);
+    int status;
+    REQUIRE(waitpid(pid, &status, 0) == pid);
+    INFO(command << " printed " << out);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+    return out;
+}
+
+TEST_CASE("preloaded shell and coreutils", "[malloc3]")
+{
+    // every exec starts allocating inside the loader and libc's own init
+    REQUIRE(runPreloaded("echo hello") == "hello\n");
+    // sort's worker threads share the heap
+    REQUIRE(runPreloaded("seq 300000 | sort -r --parallel=4 | sort -n | tail -n 1") == "300000\n");
+}
+
+static bool installed(const char *program)
+{
+    std::string command = std::string("command -v ") + program + " >/dev/null 2>&1";
+    return system(command.c_str()) == 0;
+}
+
+TEST_CASE("preloaded interpreters past the 32 arenas", "[malloc3]")
+{
+    // a few hundred thousand small blocks, well over the tests' 4MB heap
+    if (installed("perl"))
+    {
+        REQUIRE(runPreloaded("perl -e 'my %h; $h{$_} = $_ x 3 for 1..200000; print scalar(keys %h), qq(\\n)'") ==
+                "200000\n");
+    }
+    else
+    {
+        WARN("perl is not installed, skipped");
+    }
+    // ctypes goes through dlopen and dlsym, which allocate from the shim too
+    if (installed("python3"))
+    {
+        REQUIRE(runPreloaded("python3 -c 'import ctypes; d = {i: str(i) for i in range(100000)}; "
+                             "print(len(d), ctypes.CDLL(None).strlen(b\"abc\"))'") == "100000 3\n");
+    }
+    else
+    {
+        WARN("python3 is not installed, skipped");
+    }
+}
@@ -0,0 +1,96 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+
+#define MMAP_THRESHOLD (128 * 1024)
+#define NUM_ARENAS 32
+
+alignas(16) static char pool[NUM_ARENAS * MMAP_THRESHOLD + 3 * MMAP_THRESHOLD];
+
+static bool inPool(void *p)
+{
+    return (char *)p >= pool && (char *)p < pool + sizeof(pool);
+}
+
+static void fillHeap(SHeap *heap, int arenas)
+{
+    void *blocks[NUM_ARENAS];
+    for (int i = 0; i < arenas; i++)
+    {
+        blocks[i] = sheap_alloc(heap, MMAP_THRESHOLD - _size_meta_data());
+        REQUIRE(blocks[i] != nullptr);
+        memset(blocks[i], i, MMAP_THRESHOLD - _size_meta_data());
+    }
+    REQUIRE(sheap_alloc(heap, 40) == nullptr);
+    for (int i = 0; i < arenas; i++)
+    {
+        sheap_free(heap, blocks[i]);
+    }
+}
+
+// runs first, before anything touches the global heap
+TEST_CASE("global heap on a fixed buffer", "[malloc3]")
+{
+    REQUIRE(smalloc_use_provider(sprovider_fixed(pool, sizeof(pool))));
+    void *p = smalloc(40);
+    REQUIRE(p != nullptr);
+    REQUIRE(inPool(p));
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS + 10);
+    REQUIRE_FALSE(smalloc_use_provider(sprovider_mmap()));
+    sfree(p);
+}
+
+TEST_CASE("heap on a fixed buffer", "[malloc3]")
+{
+    SProvider *fixed = sprovider_fixed(pool, sizeof(pool));
+    REQUIRE(fixed != nullptr);
+    SHeap *heap = sheap_create_with(fixed, 4 * MMAP_THRESHOLD);
+    REQUIRE(heap != nullptr);
+    REQUIRE(inPool(heap));
+    void *p = sheap_alloc(heap, 40);
+    REQUIRE(inPool(p));
+    sheap_free(heap, p);
+    fillHeap(heap, 4);
+
+    // too big for what is left of the buffer
+    REQUIRE(sheap_create_with(fixed, NUM_ARENAS * MMAP_THRESHOLD) == nullptr);
+    sheap_destroy(heap);
+    // the buffer is handed out again once the heap is gone
+    heap = sheap_create_with(fixed, NUM_ARENAS * MMAP_THRESHOLD);
+    REQUIRE(heap != nullptr);
+    fillHeap(heap, NUM_ARENAS);
+    sheap_destroy(heap);
+
+    REQUIRE(sprovider_fixed(pool, 8) == nullptr);
+}
+
+TEST_CASE("heaps on mapped providers", "[malloc3]")
+{
+    SProvider *providers[] = {sprovider_mmap(), sprovider_hugetlb(), sprovider_memfd(),
+                              sprovider_reserved(16 * MMAP_THRESHOLD + 4096 * 16)};
+    for (SProvider *provider : providers)
+    {
+        REQUIRE(provider != nullptr);
+        SHeap *heap = sheap_create_with(provider, 8 * MMAP_THRESHOLD);
+        REQUIRE(heap != nullptr);
+        fillHeap(heap, 8);
+        sheap_destroy(heap);
+    }
+}
+
+TEST_CASE("reserved provider runs out", "[malloc3]")
+{
+    SProvider *reserved = sprovider_reserved(4 * MMAP_THRESHOLD);
+    REQUIRE(reserved != nullptr);
+    SHeap *a = sheap_create_with(reserved, 2 * MMAP_THRESHOLD);
+    REQUIRE(a != nullptr);
+    SHeap *b = sheap_create_with(reserved, 2 * MMAP_THRESHOLD);
+    REQUIRE(b == nullptr);
+    fillHeap(a, 2);
+    sheap_destroy(a);
+    b = sheap_create_with(reserved, 2 * MMAP_THRESHOLD);
+    REQUIRE(b != nullptr);
+    fillHeap(b, 2);
+    sheap_destroy(b);
+}
@@ -0,0 +1,39 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+#include <unistd.h>
+
+TEST_CASE("sring wraps contiguously", "[malloc3]")
+{
+    size_t page = getpagesize();
+    REQUIRE(sring_alloc(0) == nullptr);
+    REQUIRE(sring_alloc(page + 1) == nullptr);
+
+    size_t size = 4 * page;
+    char *ring = (char *)sring_alloc(size);
+    REQUIRE(ring != nullptr);
+
+    // a record written across the end lands at the start too
+    const char record[] = "a record that straddles the end of the ring";
+    size_t offset = size - 10;
+    memcpy(ring + offset, record, sizeof(record));
+    REQUIRE(memcmp(ring + offset, record, sizeof(record)) == 0);
+    REQUIRE(memcmp(ring, record + 10, sizeof(record) - 10) == 0);
+
+    // and is read back as one span from either half
+    ring[5] = 'X';
+    REQUIRE(ring[size + 5] == 'X');
+
+    // streaming: the writer keeps going round, records stay contiguous
+    size_t head = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        char buf[100];
+        memset(buf, 'a' + i % 26, sizeof(buf));
+        memcpy(ring + head, buf, sizeof(buf));
+        REQUIRE(memcmp(ring + head, buf, sizeof(buf)) == 0);
+        head = (head + sizeof(buf)) % size;
+    }
+    sring_free(ring, size);
+}
@@ -0,0 +1,140 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MMAP_THRESHOLD (128 * 1024)
+#define QUEUE_SIZE 1024
+#define MESSAGES 200000
+#define WORKERS 2
+
+struct Message
+{
+    int worker;
+    int seq;
+    char payload[40];
+};
+
+// single producer single consumer queue of message offsets
+struct Queue
+{
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    size_t slots[QUEUE_SIZE];
+};
+
+struct Channels
+{
+    Queue queues[WORKERS];
+};
+
+static void push(Queue *q, size_t offset)
+{
+    size_t tail = q->tail.load(std::memory_order_relaxed);
+    while (tail - q->head.load(std::memory_order_acquire) == QUEUE_SIZE)
+    {
+        sched_yield();
+    }
+    q->slots[tail % QUEUE_SIZE] = offset;
+    q->tail.store(tail + 1, std::memory_order_release);
+}
+
+static size_t pop(Queue *q)
+{
+    size_t head = q->head.load(std::memory_order_relaxed);
+    while (q->tail.load(std::memory_order_acquire) == head)
+    {
+        sched_yield();
+    }
+    size_t offset = q->slots[head % QUEUE_SIZE];
+    q->head.store(head + 1, std::memory_order_release);
+    return offset;
+}
+
+TEST_CASE("sshm messages between processes", "[malloc3]")
+{
+    int fd = memfd_create("sshm_test", 0);
+    REQUIRE(fd != -1);
+    PHeap *heap = sshm_map(fd, 8 * MMAP_THRESHOLD);
+    REQUIRE(heap != nullptr);
+    Channels *channels = (Channels *)sshm_alloc(heap, sizeof(Channels));
+    REQUIRE(channels != nullptr);
+    memset((void *)channels, 0, sizeof(Channels));
+    pheap_set_root(heap, channels);
+
+    // producers map the fd again, so the heap is at another address in them
+    for (int w = 0; w < WORKERS; w++)
+    {
+        if (fork() == 0)
+        {
+            PHeap *mine = sshm_map(fd, 0);
+            Channels *ch = (Channels *)pheap_root(mine);
+            for (int i = 0; i < MESSAGES; i++)
+            {
+                Message *m;
+                while (!(m = (Message *)sshm_alloc(mine, sizeof(Message))))
+                {
+                    sched_yield();
+                }
+                m->worker = w;
+                m->seq = i;
+                memset(m->payload, 'a' + w, sizeof(m->payload));
+                push(&ch->queues[w], pheap_offset(mine, m));
+            }
+            _exit(0);
+        }
+    }
+
+    int next[WORKERS] = {};
+    bool ok = true;
+    for (int i = 0; i < MESSAGES; i++)
+    {
+        for (int w = 0; w < WORKERS; w++)
+        {
+            Message *m = (Message *)pheap_at(heap, pop(&channels->queues[w]));
+            ok = ok && m->worker == w && m->seq == next[w]++ && m->payload[39] == 'a' + w;
+            sshm_free(heap, m);
+        }
+    }
+    REQUIRE(ok);
+    for (int w = 0; w < WORKERS; w++)
+    {
+        int status;
+        REQUIRE(wait(&status) > 0);
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+    }
+
+    // every message went back, so the whole heap is free again
+    sshm_free(heap, channels);
+    for (int i = 0; i < 8; i++)
+    {
+        REQUIRE(sshm_alloc(heap, MMAP_THRESHOLD - 32) != nullptr);
+    }
+    REQUIRE(sshm_alloc(heap, 1) == nullptr);
+    sshm_unmap(heap);
+    close(fd);
+}
+
+TEST_CASE("sshm_open by name", "[malloc3]")
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/sshm_test_%d", getpid());
+    PHeap *a = sshm_open(name, MMAP_THRESHOLD);
+    PHeap *b = sshm_open(name, 0);
+    REQUIRE(a != nullptr);
+    REQUIRE(b != nullptr);
+    REQUIRE(a != b);
+    char *p = (char *)sshm_alloc(a, 100);
+    strcpy(p, "shared");
+    REQUIRE(strcmp((char *)pheap_at(b, pheap_offset(a, p)), "shared") == 0);
+    sshm_free(b, pheap_at(b, pheap_offset(a, p)));
+    REQUIRE(sshm_alloc(a, MMAP_THRESHOLD - 32) != nullptr);
+    sshm_unmap(a);
+    sshm_unmap(b);
+    shm_unlink(name);
+}
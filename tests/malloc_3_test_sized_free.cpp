@@ -0,0 +1,65 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#define MMAP_THRESHOLD (128 * 1024)
+
+TEST_CASE("sfree_sized matches sfree", "[malloc3]")
+{
+    void *base = smalloc(10);
+    REQUIRE(base != nullptr);
+    size_t free_blocks = _num_free_blocks();
+    size_t free_bytes = _num_free_bytes();
+    size_t allocated_blocks = _num_allocated_blocks();
+    size_t allocated_bytes = _num_allocated_bytes();
+
+    void *small = smalloc(200);
+    void *mid = smalloc(5000);
+    void *big = smalloc(MMAP_THRESHOLD + 100);
+    REQUIRE(small != nullptr);
+    REQUIRE(mid != nullptr);
+    REQUIRE(big != nullptr);
+
+    sfree_sized(small, 200);
+    sfree_sized(mid, 5000);
+    sfree_sized(big, MMAP_THRESHOLD + 100);
+
+    REQUIRE(_num_free_blocks() == free_blocks);
+    REQUIRE(_num_free_bytes() == free_bytes);
+    REQUIRE(_num_allocated_blocks() == allocated_blocks);
+    REQUIRE(_num_allocated_bytes() == allocated_bytes);
+
+    // any size that rounds to the same order frees the same block
+    size_t capacity;
+    void *p = smalloc_capacity(200, &capacity);
+    REQUIRE(p == small);
+    sfree_sized(p, capacity);
+    REQUIRE(_num_free_blocks() == free_blocks);
+    REQUIRE(_num_free_bytes() == free_bytes);
+
+    sfree_sized(nullptr, 10);
+    sfree(base);
+}
+
+TEST_CASE("sfree_sized on an mmap'd block srealloc shrank", "[malloc3]")
+{
+    // with the heap full, shrinking below the threshold leaves the block mmap'd
+    void *arenas[32];
+    for (void *&arena : arenas)
+    {
+        arena = smalloc(MMAP_THRESHOLD - _size_meta_data());
+        REQUIRE(arena != nullptr);
+    }
+    size_t allocated_blocks = _num_allocated_blocks();
+    size_t allocated_bytes = _num_allocated_bytes();
+    void *big = smalloc(MMAP_THRESHOLD + 100);
+    REQUIRE(srealloc(big, 100) == big);
+
+    sfree_sized(big, 100);
+    REQUIRE(_num_allocated_blocks() == allocated_blocks);
+    REQUIRE(_num_allocated_bytes() == allocated_bytes);
+    for (void *arena : arenas)
+    {
+        sfree(arena);
+    }
+    REQUIRE(_num_free_blocks() == 32);
+}
@@ -0,0 +1,40 @@
+#include "my_stdlib.h"
+#include "../malloc_3.h"
+#include <catch2/catch_test_macros.hpp>
+
+#define MMAP_THRESHOLD (128 * 1024)
+#define NUM_ARENAS 32
+
+static_assert(smalloc_order_for(1) == 0, "");
+static_assert(smalloc_order_for(128 - SMALLOC_META_DATA_SIZE) == 0, "");
+static_assert(smalloc_order_for(128 - SMALLOC_META_DATA_SIZE + 1) == 1, "");
+static_assert(smalloc_order_for(MMAP_THRESHOLD - SMALLOC_META_DATA_SIZE) == 10, "");
+static_assert(smalloc_order_for(MMAP_THRESHOLD) == -1, "");
+
+TEST_CASE("smalloc<N> matches smalloc", "[malloc3]")
+{
+    REQUIRE(_size_meta_data() == SMALLOC_META_DATA_SIZE);
+
+    void *a = smalloc<40>();
+    REQUIRE(a != nullptr);
+    REQUIRE(susable_size(a) == 128 - _size_meta_data());
+    REQUIRE(_num_free_blocks() == NUM_ARENAS - 1 + 10);
+
+    // the split left a free order 0 buddy, which is popped directly
+    void *b = smalloc<80>();
+    REQUIRE((char *)b == (char *)a + 128);
+    REQUIRE(_num_free_blocks() == NUM_ARENAS - 1 + 9);
+
+    void *c = smalloc<MMAP_THRESHOLD + 100>();
+    REQUIRE(c != nullptr);
+    REQUIRE(_num_allocated_bytes() == NUM_ARENAS * (MMAP_THRESHOLD - _size_meta_data()) -
+                                          10 * _size_meta_data() + MMAP_THRESHOLD + 100);
+
+    sfree<40>(a);
+    sfree<80>(b);
+    sfree<MMAP_THRESHOLD + 100>(c);
+    sfree<40>(nullptr);
+    REQUIRE(_num_free_blocks() == NUM_ARENAS);
+    REQUIRE(_num_allocated_blocks() == NUM_ARENAS);
+    REQUIRE(_num_free_bytes() == NUM_ARENAS * (MMAP_THRESHOLD - _size_meta_data()));
+}
@@ -0,0 +1,45 @@
+#include "my_stdlib.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+
+#define MMAP_THRESHOLD (128 * 1024)
+
+TEST_CASE("susable_size", "[malloc3]")
+{
+    REQUIRE(susable_size(nullptr) == 0);
+
+    char *a = (char *)smalloc(200);
+    REQUIRE(a != nullptr);
+    REQUIRE(susable_size(a) == 256 - _size_meta_data());
+
+    char *b = (char *)smalloc(MMAP_THRESHOLD + 100);
+    REQUIRE(b != nullptr);
+    REQUIRE(susable_size(b) == MMAP_THRESHOLD + 100);
+
+    char *c = (char *)saligned_alloc(1024, 200);
+    REQUIRE(c != nullptr);
+    REQUIRE(susable_size(c) == 1024);
+
+    sfree(a);
+    sfree(b);
+    sfree(c);
+}
+
+TEST_CASE("smalloc_capacity", "[malloc3]")
+{
+    size_t capacity = 0;
+    char *a = (char *)smalloc_capacity(200, &capacity);
+    REQUIRE(a != nullptr);
+    REQUIRE(capacity == 256 - _size_meta_data());
+    memset(a, 'a', capacity);
+
+    size_t free_blocks = _num_free_blocks();
+    char *b = (char *)srealloc(a, capacity);
+    REQUIRE(b == a);
+    REQUIRE(_num_free_blocks() == free_blocks);
+
+    REQUIRE(smalloc_capacity(0, &capacity) == nullptr);
+    REQUIRE(capacity == 0);
+    sfree(b);
+}
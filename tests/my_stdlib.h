@@ -7,6 +7,7 @@ void *smalloc(size_t size);
 void *scalloc(size_t num, size_t size);
 void sfree(void *p);
 void *srealloc(void *oldp, size_t size);
+bool sexpand(void *p, size_t new_size);
 
 size_t _num_free_blocks();
 size_t _num_free_bytes();
@@ -15,4 +16,60 @@ size_t _num_allocated_bytes();
 size_t _num_meta_data_bytes();
 size_t _size_meta_data();
 
+void sfree_sized(void *p, size_t size);
+void *saligned_alloc(size_t alignment, size_t size);
+size_t susable_size(void *p);
+void *smalloc_capacity(size_t size, size_t *capacity);
+size_t smalloc_batch(size_t size, size_t n, void **out);
+void sfree_batch(void *const *ptrs, size_t n);
+
+void *sclone(void *p);
+void *sring_alloc(size_t size);
+void sring_free(void *ring, size_t size);
+
+struct SProvider;
+SProvider *sprovider_sbrk();
+SProvider *sprovider_mmap();
+SProvider *sprovider_hugetlb();
+SProvider *sprovider_memfd();
+SProvider *sprovider_reserved(size_t capacity);
+SProvider *sprovider_fixed(void *buffer, size_t size);
+bool smalloc_use_provider(SProvider *provider);
+bool smalloc_set_max_arenas(int arenas);
+void smalloc_set_address_ordered(bool ordered);
+void *smalloc_mmap(size_t size, size_t alignment);
+void smalloc_lock();
+void smalloc_unlock();
+
+struct SHeap;
+SHeap *sheap_create(size_t size);
+SHeap *sheap_create_with(SProvider *provider, size_t size);
+void *sheap_alloc(SHeap *heap, size_t size);
+void sheap_free(SHeap *heap, void *p);
+void sheap_destroy(SHeap *heap);
+
+struct PHeap;
+PHeap *pheap_open(const char *path, size_t size);
+PHeap *pheap_recover(const char *path);
+void pheap_close(PHeap *heap);
+void *pheap_alloc(PHeap *heap, size_t size);
+void pheap_free(PHeap *heap, void *p);
+void *pheap_root(PHeap *heap);
+void pheap_set_root(PHeap *heap, void *p);
+size_t pheap_offset(PHeap *heap, void *p);
+void *pheap_at(PHeap *heap, size_t offset);
+PHeap *sshm_map(int fd, size_t size);
+PHeap *sshm_open(const char *name, size_t size);
+void sshm_unmap(PHeap *heap);
+void *sshm_alloc(PHeap *heap, size_t size);
+void sshm_free(PHeap *heap, void *p);
+
+struct Arena;
+Arena *sarena_create(size_t size);
+void *sarena_alloc(Arena *arena, size_t size);
+void *sarena_mark(Arena *arena);
+void sarena_rewind(Arena *arena, void *mark);
+void sarena_reset(Arena *arena);
+void sarena_destroy(Arena *arena);
+
 #endif /* MY_STDLIB_H */
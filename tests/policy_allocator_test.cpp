@@ -0,0 +1,81 @@
+#include "../policy_allocator.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <unistd.h>
+
+TEST_CASE("Malloc1Allocator bumps through chunks", "[policy]")
+{
+    Malloc1Allocator a;
+    char *p1 = (char *)a.smalloc(10);
+    void *brk = sbrk(0);
+    char *p2 = (char *)a.smalloc(10);
+    REQUIRE(sbrk(0) == brk);
+    REQUIRE(p2 == p1 + 32);
+    REQUIRE((size_t)p1 % POLICY_ALIGNMENT == 0);
+
+    // the first 1MB chunk takes all of these, the next refill doubles it
+    for (int i = 0; i < 1000; i++)
+    {
+        REQUIRE(a.smalloc(1000) != nullptr);
+    }
+    REQUIRE(sbrk(0) == brk);
+    REQUIRE(a.smalloc(1024 * 1024) != nullptr);
+    REQUIRE((char *)sbrk(0) - (char *)brk == 2 * 1024 * 1024);
+
+    // nothing is reused
+    a.sfree(p1);
+    REQUIRE(a.smalloc(10) != p1);
+    REQUIRE(a.srealloc(p2, 0) == nullptr);
+}
+
+TEST_CASE("Malloc2Allocator first fit and the wilderness block", "[policy]")
+{
+    Malloc2Allocator a;
+    char *small = (char *)a.smalloc(100);
+    char *big = (char *)a.smalloc(300);
+    char *last = (char *)a.smalloc(100);
+    a.sfree(small);
+    a.sfree(big);
+    // the first free block that fits, not the first free block
+    REQUIRE(a.smalloc(200) == big);
+    REQUIRE(a.smalloc(50) == small);
+
+    // a free tail grows in place
+    a.sfree(last);
+    void *brk = sbrk(0);
+    REQUIRE(a.smalloc(1000) == last);
+    REQUIRE((char *)sbrk(0) - (char *)brk == 1008 - 112);
+
+    // srealloc to 0 frees
+    REQUIRE(a.srealloc(last, 0) == nullptr);
+    REQUIRE(a.smalloc(500) == last);
+
+    // more blocks than the index starts out with
+    for (int i = 0; i < 3000; i++)
+    {
+        REQUIRE(a.smalloc(16) != nullptr);
+    }
+}
+
+TEST_CASE("Malloc3Allocator buddies and mmap", "[policy]")
+{
+    Malloc3Allocator a;
+    char *p1 = (char *)a.smalloc(40);
+    char *p2 = (char *)a.smalloc(40);
+    REQUIRE(p2 == p1 + 128);
+    a.sfree(p1);
+    a.sfree(p2);
+    // the halves merged back into the first arena
+    char *arena = (char *)a.smalloc(100000);
+    REQUIRE(arena == p1);
+
+    char *large = (char *)a.smalloc(200000);
+    REQUIRE(large != nullptr);
+    REQUIRE((large < arena || large >= arena + 32 * 128 * 1024));
+    large[199999] = 1;
+    char *grown = (char *)a.srealloc(arena, 110000);
+    REQUIRE(grown == arena);
+    REQUIRE(a.srealloc(large, 0) == nullptr);
+    a.sfree(grown);
+    REQUIRE(a.smalloc(100000) == arena);
+}